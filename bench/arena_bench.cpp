@@ -0,0 +1,39 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include "alloc/arena.hpp"
+#include "fs_node.hpp"
+
+namespace rbs {
+
+namespace {
+
+// Every allocation stays alive until the arena is destroyed, so the iteration count is pinned to
+// keep memory use in check.
+constexpr benchmark::IterationCount kAllocationsPerThread = 1 << 16;
+
+std::unique_ptr<alloc::MPArena<FsNode>> arena;
+
+void BM_UnfencedAlloc(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    arena = std::make_unique<alloc::MPArena<FsNode>>();
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(arena->UnfencedAlloc());
+  }
+
+  if (state.thread_index() == 0) {
+    arena.reset();
+  }
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_UnfencedAlloc)
+    ->Iterations(kAllocationsPerThread)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+}  // namespace
+
+}  // namespace rbs
@@ -0,0 +1,39 @@
+#include <benchmark/benchmark.h>
+#include <array>
+#include <cstddef>
+#include <format>
+#include <vector>
+#include <dirent.h>
+#include "fs_node.hpp"
+#include "result.hpp"
+
+namespace rbs {
+
+namespace {
+
+void BM_ComputePathStr(benchmark::State& state) {
+  static constexpr std::size_t kMaxPath = 4096ULL * 4ULL;
+
+  const auto depth = static_cast<std::size_t>(state.range(0));
+
+  std::vector<FsNode> nodes(depth);
+  for (std::size_t i = 0; i < depth; ++i) {
+    AssignEntry(nodes[i], std::format("directory-{}", i), i + 1 == depth ? DT_REG : DT_DIR,
+                i == 0 ? nullptr : &nodes[i - 1]);
+  }
+
+  std::array<char, kMaxPath> path_buf;
+  Result result{&nodes.back()};
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(result.ComputePathStr(path_buf, '\n'));
+  }
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_ComputePathStr)->ArgName("depth")->RangeMultiplier(2)->Range(1, 256);
+
+}  // namespace
+
+}  // namespace rbs
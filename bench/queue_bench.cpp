@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+#include "concurrentqueue.h"
+#include "jobs/search_file_job.hpp"
+#include "result.hpp"
+#include "worker.hpp"
+
+namespace rbs {
+
+namespace {
+
+// These go through the same queue types, tokens and size classes the Scheduler hands its workers.
+//
+// The queues outlive every run, since the threads' tokens are torn down at different times after
+// the timed loop ends, and a token must not outlive its queue.
+
+SearchFileQueue searchFileQueue;
+moodycamel::ConcurrentQueue<Result> resultQueue;
+
+/// @brief Every thread submits a search job and then takes one, like a worker which found a file
+///        during traversal and then goes searching.
+void BM_SearchFileQueueRoundTrip(benchmark::State& state) {
+  // Spread jobs over every size class, so we exercise all of the queues.
+  const auto size_class =
+      static_cast<std::size_t>(state.thread_index()) % SearchFileQueue::kClasses;
+  const std::size_t file_size =
+      size_class < SearchFileJob::kSizeClassThresholds.size()
+          ? SearchFileJob::kSizeClassThresholds[size_class]
+          : 1;
+
+  // The jobs are never serviced, so any non-null node will do.
+  static FsNode node{};
+
+  SearchFileQueue::ProducerTokens producer_tokens = searchFileQueue.MakeProducerTokens();
+  SearchFileQueue::ConsumerTokens consumer_tokens = searchFileQueue.MakeConsumerTokens();
+
+  for (auto _ : state) {
+    SearchFileJob job{&node, -1, file_size};
+    searchFileQueue.Enqueue(producer_tokens, job.SizeClass(), std::move(job));
+
+    SearchFileJob dequeued;
+    for (std::size_t i = 0; i < SearchFileQueue::kClasses; ++i) {
+      if (searchFileQueue.TryDequeue(consumer_tokens, i, dequeued)) {
+        break;
+      }
+    }
+    benchmark::DoNotOptimize(dequeued);
+  }
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_SearchFileQueueRoundTrip)->ThreadRange(1, 16)->UseRealTime();
+
+/// @brief Every thread but the first pushes results, while the first drains them, like the main
+///        thread printing results.
+void BM_ResultQueueFanIn(benchmark::State& state) {
+  // Results are never printed, so any node will do.
+  static FsNode node{};
+
+  if (state.thread_index() == 0) {
+    moodycamel::ConsumerToken token{resultQueue};
+    for (auto _ : state) {
+      Result result{nullptr};
+      benchmark::DoNotOptimize(resultQueue.try_dequeue(token, result));
+    }
+
+    // The producers are done by now. Drain what they left behind so the next run starts empty.
+    Result result{nullptr};
+    while (resultQueue.try_dequeue(result)) {}
+  } else {
+    moodycamel::ProducerToken token{resultQueue};
+    for (auto _ : state) {
+      resultQueue.enqueue(token, Result{&node});
+    }
+  }
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_ResultQueueFanIn)->ThreadRange(2, 16)->UseRealTime();
+
+}  // namespace
+
+}  // namespace rbs
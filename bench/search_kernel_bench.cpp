@@ -0,0 +1,53 @@
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "search_kernel.hpp"
+
+namespace rbs {
+
+namespace {
+
+/// @brief Builds a haystack of pseudo-random lowercase text with the needle at the very end, so
+///        that every search has to scan all of it.
+auto makeHaystack(std::size_t haystackSize, const std::string& needle) -> std::string {
+  std::string haystack(haystackSize, '\0');
+
+  std::uint64_t state = 0x9E3779B97F4A7C15ULL;
+  for (char& character : haystack) {
+    state ^= state << 13U;
+    state ^= state >> 7U;
+    state ^= state << 17U;
+    character = static_cast<char>('a' + (state % 26));
+  }
+
+  haystack.replace(haystack.size() - needle.size(), needle.size(), needle);
+  return haystack;
+}
+
+void BM_ContainsNeedle(benchmark::State& state) {
+  const auto needle_size = static_cast<std::size_t>(state.range(0));
+  const auto haystack_size = static_cast<std::size_t>(state.range(1));
+
+  // Upper case never occurs in the generated text, so the only match is the one we plant.
+  const std::string needle(needle_size, 'Q');
+  const std::string haystack = makeHaystack(haystack_size, needle);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ContainsNeedle(haystack, needle));
+  }
+
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) *
+                          static_cast<std::int64_t>(haystack_size));
+}
+
+BENCHMARK(BM_ContainsNeedle)
+    ->ArgNames({"needle", "haystack"})
+    ->ArgsProduct({
+        {1, 3, 8, 16, 64},
+        {64, 4 << 10, 64 << 10, 1 << 20, 16 << 20},
+    });
+
+}  // namespace
+
+}  // namespace rbs
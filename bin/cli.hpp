@@ -1,27 +1,41 @@
 #ifndef CLI_HPP
 #define CLI_HPP
 
+#include <algorithm>
 #include <charconv>
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
 #include <span>
 #include <thread>
+#include "stats.hpp"
 
 namespace rbs {
 
 class CliArgs {
  public:
+  enum class Mode : std::uint8_t {
+    /// @brief Run a single search, and print its results.
+    Search,
+    /// @brief Answer searches over a socket until killed.
+    Serve,
+  };
+
   constexpr explicit CliArgs(std::span<char*> args) noexcept {
-    if (args.size() < 3) {
+    auto first_option = args.begin() + 3;
+    // A directory named serve has to be given as ./serve to be searched.
+    if (args.size() >= 2 && std::string_view(args[1]) == "serve") {
+      mode_ = Mode::Serve;
+      first_option = args.begin() + 2;
+    } else if (args.size() < 3) {
       printHelp();
       std::exit(2);
+    } else {
+      searchPath_ = std::filesystem::path(args[1]);
+      searchString_ = std::string_view(args[2]);
     }
 
-    searchPath_ = std::filesystem::path(args[1]);
-    searchString_ = std::string_view(args[2]);
-
-    for (auto arg_it = args.begin() + 3; arg_it != args.end(); ++arg_it) {
+    for (auto arg_it = first_option; arg_it != args.end(); ++arg_it) {
       std::string_view arg = (*arg_it);
 
       if (arg == "--help" || arg == "-h") {
@@ -35,6 +49,108 @@ class CliArgs {
         continue;
       }
 
+      if (arg == "--stats" || arg == "--stats=text") {
+        statsFormat_ = stats::Format::Text;
+        searchOnlyOption_ = arg;
+        continue;
+      }
+
+      if (arg == "--stats=json") {
+        statsFormat_ = stats::Format::Json;
+        searchOnlyOption_ = arg;
+        continue;
+      }
+
+      if (arg == "--trace") {
+        searchOnlyOption_ = arg;
+        if (++arg_it == args.end()) {
+          std::cerr << "Error: Missing value for --trace option.\n";
+          std::exit(2);
+        }
+
+        tracePath_ = std::filesystem::path(*arg_it);
+        continue;
+      }
+
+      if (arg == "--trace-sample") {
+        searchOnlyOption_ = arg;
+        if (++arg_it == args.end()) {
+          std::cerr << "Error: Missing value for --trace-sample option.\n";
+          std::exit(2);
+        }
+
+        char* sample_str = *arg_it;
+
+        auto [ptr, ec] =
+            std::from_chars(sample_str, sample_str + std::strlen(sample_str), traceSampleEvery_);
+
+        if (ec != std::errc{} || traceSampleEvery_ == 0) {
+          std::cerr << "Error: Invalid value for --trace-sample option: " << sample_str << "\n";
+          std::exit(2);
+        }
+
+        continue;
+      }
+
+      if (arg == "--fifo") {
+        sizeAwareScheduling_ = false;
+        continue;
+      }
+
+      if (arg == "--no-raise-fd-limit") {
+        raiseFdLimit_ = false;
+        continue;
+      }
+
+      if (arg == "--socket") {
+        serveOnlyOption_ = arg;
+        if (++arg_it == args.end()) {
+          std::cerr << "Error: Missing value for --socket option.\n";
+          std::exit(2);
+        }
+
+        socketPath_ = std::filesystem::path(*arg_it);
+        continue;
+      }
+
+      if (arg == "--search-zip" || arg == "-z") {
+        searchCompressed_ = true;
+        continue;
+      }
+
+      if (arg == "--follow" || arg == "-L") {
+        followSymlinks_ = true;
+        continue;
+      }
+
+      if (arg == "--dedupe-files") {
+        dedupeFiles_ = true;
+        continue;
+      }
+
+      if (arg == "--names") {
+        matchNames_ = true;
+        searchOnlyOption_ = arg;
+        continue;
+      }
+
+      if (arg == "--files-from") {
+        searchOnlyOption_ = arg;
+        if (++arg_it == args.end()) {
+          std::cerr << "Error: Missing value for --files-from option.\n";
+          std::exit(2);
+        }
+
+        filesFrom_ = std::filesystem::path(*arg_it);
+        continue;
+      }
+
+      if (arg == "--no-cache") {
+        cacheDirectories_ = false;
+        serveOnlyOption_ = arg;
+        continue;
+      }
+
       if (arg == "--jobs" || arg == "-j") {
         if (++arg_it == args.end()) {
           std::cerr << "Error: Missing value for --jobs option.\n";
@@ -45,7 +161,7 @@ class CliArgs {
 
         auto [ptr, ec] = std::from_chars(jobs_str, jobs_str + std::strlen(jobs_str), jobs_);
 
-        if (ec != std::errc{}) {
+        if (ec != std::errc{} || jobs_ == 0) {
           std::cerr << "Error: Invalid value for --jobs option: " << jobs_str << "\n";
           std::exit(2);
         }
@@ -54,10 +170,36 @@ class CliArgs {
       }
 
       std::cerr << "Error: Unknown option '" << arg << "'. Use --help for usage information.\n";
+      if (mode_ == Mode::Serve && !arg.starts_with('-')) {
+        std::cerr << "To search a directory named serve, write it as ./serve.\n";
+      }
+      std::exit(2);
+    }
+
+    if (mode_ == Mode::Serve && !searchOnlyOption_.empty()) {
+      std::cerr << "Error: " << searchOnlyOption_
+                << " only applies to a single search, not serve.\n";
+      std::exit(2);
+    }
+
+    if (mode_ == Mode::Search && !serveOnlyOption_.empty()) {
+      std::cerr << "Error: " << serveOnlyOption_ << " only applies to serve.\n";
+      std::exit(2);
+    }
+
+    if (matchNames_ && !filesFrom_.empty()) {
+      std::cerr << "Error: --names cannot be combined with --files-from.\n";
+      std::exit(2);
+    }
+
+    if (mode_ == Mode::Serve && socketPath_.empty()) {
+      std::cerr << "Error: serve requires --socket <PATH>.\n";
       std::exit(2);
     }
   }
 
+  [[nodiscard]] constexpr auto GetMode() const noexcept -> Mode { return mode_; }
+
   [[nodiscard]] constexpr auto SearchPath() const noexcept -> const std::filesystem::path& {
     return searchPath_;
   }
@@ -70,24 +212,103 @@ class CliArgs {
 
   [[nodiscard]] constexpr auto Jobs() const noexcept -> std::uint16_t { return jobs_; }
 
+  [[nodiscard]] constexpr auto RaiseFdLimit() const noexcept -> bool { return raiseFdLimit_; }
+
+  [[nodiscard]] constexpr auto SizeAwareScheduling() const noexcept -> bool {
+    return sizeAwareScheduling_;
+  }
+
+  [[nodiscard]] constexpr auto StatsFormat() const noexcept -> stats::Format {
+    return statsFormat_;
+  }
+
+  /// @brief Where to write a Chrome trace to, or an empty path if tracing is off.
+  [[nodiscard]] constexpr auto TracePath() const noexcept -> const std::filesystem::path& {
+    return tracePath_;
+  }
+
+  [[nodiscard]] constexpr auto TraceSampleEvery() const noexcept -> std::uint32_t {
+    return traceSampleEvery_;
+  }
+
+  [[nodiscard]] constexpr auto SearchCompressed() const noexcept -> bool {
+    return searchCompressed_;
+  }
+
+  [[nodiscard]] constexpr auto FollowSymlinks() const noexcept -> bool { return followSymlinks_; }
+
+  [[nodiscard]] constexpr auto DedupeFiles() const noexcept -> bool { return dedupeFiles_; }
+
+  /// @brief Whether to look for the search string in entry names rather than file contents.
+  [[nodiscard]] constexpr auto MatchNames() const noexcept -> bool { return matchNames_; }
+
+  /// @brief Where to read the list of files to search from, "-" for stdin, or an empty path to
+  ///        search everything under the search path.
+  [[nodiscard]] constexpr auto FilesFrom() const noexcept -> const std::filesystem::path& {
+    return filesFrom_;
+  }
+
+  /// @brief Where to listen for searches in serve mode.
+  [[nodiscard]] constexpr auto SocketPath() const noexcept -> const std::filesystem::path& {
+    return socketPath_;
+  }
+
+  /// @brief Whether to keep directory listings between searches in serve mode.
+  [[nodiscard]] constexpr auto CacheDirectories() const noexcept -> bool {
+    return cacheDirectories_;
+  }
+
  private:
   static constexpr auto defaultJobs() -> std::uint16_t {
-    return std::thread::hardware_concurrency() * 2;
+    return std::max(std::thread::hardware_concurrency(), 1U) * 2;
   }
 
   static constexpr void printHelp() {
     std::cout << "Usage: rbs <PATH> <SEARCH_STRING> [OPTIONS]\n"
+              << "       rbs serve --socket <PATH> [OPTIONS]\n"
+              << "A directory named serve has to be written as ./serve.\n"
               << "Options:\n"
               << "  -h, --help          Show this help message and exit\n"
               << "  -v, --verbose       Enable verbose output\n"
+              << "  --no-raise-fd-limit Don't raise the soft RLIMIT_NOFILE to what we can use\n"
+              << "  --fifo              Search files in the order found, not largest first\n"
+              << "  -z, --search-zip    Search inside gzip and zstd compressed files\n"
+              << "  -L, --follow        Follow symbolic links\n"
+              << "  --dedupe-files      Search files reachable through several links only once\n"
               << "  -j, --jobs <N>      Number of parallel jobs to run (default: " << defaultJobs()
-              << ")\n";
+              << ")\n"
+              << "Search options:\n"
+              << "  --names             Match file and directory names, not file contents\n"
+              << "  --files-from <FILE> Only search the files listed in FILE, or stdin for -,\n"
+              << "                      relative to PATH and separated by NUL or newlines\n"
+              << "  --stats[=json]      Print performance counters to stderr on exit\n"
+              << "  --trace <FILE>      Write a Chrome trace of job execution to FILE\n"
+              << "  --trace-sample <N>  Only trace one in every N events (default: 1)\n"
+              << "Serve options:\n"
+              << "  --socket <PATH>     Listen for searches on the Unix domain socket at PATH\n"
+              << "  --no-cache          Read every directory on every search\n";
   }
 
+  Mode mode_ = Mode::Search;
+  /// @brief The last option given which only applies to one mode, for rejecting it in the other.
+  std::string_view searchOnlyOption_;
+  std::string_view serveOnlyOption_;
   std::filesystem::path searchPath_;
   std::string_view searchString_;
+  std::filesystem::path filesFrom_;
+  std::filesystem::path socketPath_;
+  bool cacheDirectories_ = true;
   bool verbose_ = false;
   bool help_ = false;
+  bool raiseFdLimit_ = true;
+  bool sizeAwareScheduling_ = true;
+  bool searchCompressed_ = false;
+  bool followSymlinks_ = false;
+  bool dedupeFiles_ = false;
+  bool matchNames_ = false;
+  stats::Format statsFormat_ = stats::Format::None;
+  std::filesystem::path tracePath_;
+  std::uint32_t traceSampleEvery_ = 1;
   std::uint16_t jobs_ = defaultJobs();
 };
 
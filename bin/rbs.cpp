@@ -1,49 +1,86 @@
+#include <array>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <format>
+#include <fstream>
 #include <iostream>
 #include <span>
+#include <fcntl.h>
+#include <unistd.h>
 #include "cli.hpp"
-#include "concurrentqueue.h"
-#include "jobs/traverse_directory_job.hpp"
-#include "sched.hpp"
+#include "rbs/searcher.hpp"
+#include "serve.hpp"
 
 namespace rbs {
 
 namespace {
 
-[[maybe_unused]] constexpr auto printResult(std::optional<Result>&& result,
-                                            std::span<char> path_buf) -> bool {
-  if (!result.has_value()) {
-    return false;
-  }
-
-  const std::string_view path = result->ComputePathStr(path_buf, '\n');
-  std::fwrite(path.data(), sizeof(char), path.size(), stdout);
-  return true;
-}
-
 auto Main(std::span<char*> args) -> int {
   static constexpr std::size_t kMaxPath = 4096ULL * 4ULL;
-  std::array<char, kMaxPath> path_buf;
+  static constexpr std::size_t kTraceCapacity = 1ULL << 16ULL;
 
-  CliArgs cli_args{args};
+  const CliArgs cli_args{args};
+  const bool serving = cli_args.GetMode() == CliArgs::Mode::Serve;
 
-  Scheduler scheduler{cli_args.Jobs(), cli_args.SearchString()};
-  scheduler.SlowSubmit(TraverseDirectoryJob::FromPath(cli_args.SearchPath()));
-  scheduler.Run();
+  Searcher searcher{PoolOptions{
+      .Threads = cli_args.Jobs(),
+      .RaiseFdLimit = cli_args.RaiseFdLimit(),
+      .SizeAwareScheduling = cli_args.SizeAwareScheduling(),
+      .SearchCompressed = cli_args.SearchCompressed(),
+      .FollowSymlinks = cli_args.FollowSymlinks(),
+      .DedupeFiles = cli_args.DedupeFiles(),
+      .CollectStats = cli_args.StatsFormat() != stats::Format::None,
+      .TraceCapacity = cli_args.TracePath().empty() ? 0 : kTraceCapacity,
+      .TraceSampleEvery = cli_args.TraceSampleEvery(),
+      // A single search never reads a directory twice, so caching would only cost us.
+      .CacheDirectories = serving && cli_args.CacheDirectories(),
+  }};
 
-  moodycamel::ConsumerToken consumer_token = scheduler.ResultToken();
+  if (serving) {
+    Server server{cli_args.SocketPath(), searcher};
+    return server.Run();
+  }
 
-  while (true) {
-    if (!scheduler.IsBusy()) {
-      break;
+  int files_from = -1;
+  if (cli_args.FilesFrom() == "-") {
+    files_from = STDIN_FILENO;
+  } else if (!cli_args.FilesFrom().empty()) {
+    files_from = open(cli_args.FilesFrom().c_str(), O_RDONLY | O_CLOEXEC);
+    if (files_from == -1) {
+      std::cerr << std::format("Failed to open file list {}: {}\n",
+                               cli_args.FilesFrom().string(), std::strerror(errno));
+      return 1;
     }
+  }
 
-    printResult(scheduler.GetResult(consumer_token), path_buf);
+  std::array<char, kMaxPath> path_buf;
+  searcher.Search(Query{.Root = cli_args.SearchPath(),
+                        .Needle = cli_args.SearchString(),
+                        .MatchNames = cli_args.MatchNames(),
+                        .FilesFrom = files_from},
+                  [&](const Match& match) {
+                    const std::string_view path = match.Path(path_buf, '\n');
+                    std::fwrite(path.data(), sizeof(char), path.size(), stdout);
+                  });
+
+  if (files_from != -1 && files_from != STDIN_FILENO) {
+    close(files_from);
+  }
+
+  if (cli_args.StatsFormat() != stats::Format::None) {
+    std::fflush(stdout);
+    searcher.WriteStats(std::cerr, cli_args.StatsFormat());
   }
 
-  // Don't forget to flush any remaining results.
-  while (printResult(scheduler.GetResult(consumer_token), path_buf)) {}
+  if (!cli_args.TracePath().empty()) {
+    std::ofstream trace_file{cli_args.TracePath()};
+    if (!trace_file) {
+      std::cerr << std::format("Failed to open trace file {}\n", cli_args.TracePath().string());
+      return 1;
+    }
+    searcher.WriteTrace(trace_file);
+  }
 
   return 0;
 }
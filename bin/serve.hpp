@@ -0,0 +1,261 @@
+#ifndef SERVE_HPP
+#define SERVE_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "log.hpp"
+#include "rbs/searcher.hpp"
+
+namespace rbs {
+
+/// @brief Answers search requests over a Unix domain socket, with one warm Searcher.
+///
+/// A request is a single line, `<ROOT>\t<SEARCH_STRING>\n`. The response is every match's path,
+/// relative to the root as rbs prints it, on a line of its own, and then an empty line. Matches
+/// are sent in batches while the search runs. A search which fails is answered with a single
+/// `error: <MESSAGE>` line, followed by an empty line. A connection may send any number of
+/// requests, one after another.
+///
+/// Every connection is served by its own thread, up to kMaxConnections of them. Further
+/// connections wait to be accepted until one is done. The Searcher runs searches in the order
+/// they arrive. While one runs, we never block on its client: matches are only sent as far as the
+/// socket takes them without waiting, and a client which falls too far behind is dropped. So a
+/// client which is slow to read only holds up itself.
+class Server {
+ private:
+  static constexpr Logger kLogger{"Server"};
+
+  /// @brief How many connections may wait to be accepted.
+  static constexpr int kBacklog = 64;
+
+  static constexpr std::size_t kMaxPath = 4096ULL * 4ULL;
+
+  /// @brief How many connections we serve at once.
+  static constexpr std::uint32_t kMaxConnections = 64;
+
+  /// @brief How long a connection may go without sending a request, or without reading its
+  ///        response, before we hang up on it.
+  static constexpr auto kIdleTimeout = std::chrono::seconds(60);
+
+  /// @brief While searching, matches are sent once this much is waiting, or once kSendInterval
+  ///        has passed since the last send.
+  static constexpr std::size_t kSendSize = 16ULL * 1024ULL;
+  static constexpr auto kSendInterval = std::chrono::milliseconds(1);
+
+  /// @brief How much of a response may be waiting on a client which doesn't read it, before we
+  ///        give up on the client.
+  static constexpr std::size_t kMaxUnsent = 1024ULL * 1024ULL;
+
+ public:
+  /// @throws std::system_error if the socket cannot be set up.
+  Server(const std::filesystem::path& socketPath, Searcher& searcher)
+      : socketPath_(socketPath), searcher_(&searcher) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath_.native().size() >= sizeof(address.sun_path)) {
+      throw std::system_error(ENAMETOOLONG, std::generic_category(), socketPath_.native());
+    }
+    std::ranges::copy(socketPath_.native(), address.sun_path);
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ == -1) {
+      throw std::system_error(errno, std::generic_category(), "socket");
+    }
+
+    // A socket left behind by a server which didn't exit cleanly would make bind fail.
+    unlink(socketPath_.c_str());
+    if (bind(listenFd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1 ||
+        listen(listenFd_, kBacklog) == -1) {
+      const int bind_errno = errno;
+      close(listenFd_);
+      throw std::system_error(bind_errno, std::generic_category(), socketPath_.native());
+    }
+
+    // A client hanging up must not kill us. We see it as a failed send instead.
+    std::signal(SIGPIPE, SIG_IGN);
+  }
+
+  Server(const Server&) = delete;
+  Server(Server&&) = delete;
+  auto operator=(const Server&) -> Server& = delete;
+  auto operator=(Server&&) -> Server& = delete;
+
+  ~Server() {
+    close(listenFd_);
+    unlink(socketPath_.c_str());
+  }
+
+  /// @brief Accepts connections until accepting fails. Returns once every connection is done.
+  auto Run() -> int {
+    while (true) {
+      // Connections beyond the limit wait in the listen backlog until one of ours is done.
+      std::uint32_t connections = connections_.load(std::memory_order_acquire);
+      while (connections >= kMaxConnections) {
+        connections_.wait(connections, std::memory_order_acquire);
+        connections = connections_.load(std::memory_order_acquire);
+      }
+
+      const int connection_fd = accept(listenFd_, nullptr, nullptr);
+      if (connection_fd == -1) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+
+        kLogger.Error(std::format("Failed to accept a connection: {}", std::strerror(errno)));
+        break;
+      }
+
+      // A client which goes quiet would otherwise hold on to its connection forever.
+      const timeval timeout{
+          .tv_sec = std::chrono::duration_cast<std::chrono::seconds>(kIdleTimeout).count(),
+          .tv_usec = 0};
+      setsockopt(connection_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(connection_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+      connections_.fetch_add(1, std::memory_order_relaxed);
+      std::thread{[this, connection_fd] {
+        serve(connection_fd);
+        close(connection_fd);
+        connections_.fetch_sub(1, std::memory_order_release);
+        connections_.notify_all();
+      }}.detach();
+    }
+
+    // The connections use the Searcher, which must outlive them.
+    std::uint32_t connections = connections_.load(std::memory_order_acquire);
+    while (connections != 0) {
+      connections_.wait(connections, std::memory_order_acquire);
+      connections = connections_.load(std::memory_order_acquire);
+    }
+    return 1;
+  }
+
+ private:
+  void serve(int connectionFd) noexcept {
+    std::string pending;
+    std::array<char, kMaxPath> path_buf;
+    std::array<char, 4096> read_buf;
+
+    try {
+      while (true) {
+        const std::size_t newline = pending.find('\n');
+        if (newline == std::string::npos) {
+          const ssize_t length = read(connectionFd, read_buf.data(), read_buf.size());
+          if (length <= 0) {
+            // The client hung up, or went quiet for too long.
+            return;
+          }
+          pending.append(read_buf.data(), static_cast<std::size_t>(length));
+          continue;
+        }
+
+        const std::string_view request = std::string_view{pending}.substr(0, newline);
+        const std::size_t tab = request.find('\t');
+        if (tab == std::string_view::npos) {
+          sendAll(connectionFd, "error: expected <ROOT>\\t<SEARCH_STRING>\n\n");
+        } else {
+          search(connectionFd, request.substr(0, tab), request.substr(tab + 1), path_buf);
+        }
+        pending.erase(0, newline + 1);
+      }
+    } catch (const std::exception& ex) {
+      kLogger.Error(std::format("Dropping connection: {}", ex.what()));
+    }
+  }
+
+  void search(int connectionFd, std::string_view root, std::string_view needle,
+              std::span<char> pathBuf) {
+    // The Searcher runs one search at a time, so nothing may block while it calls us back. A
+    // client which stops reading would otherwise hold up every other connection. Matches are
+    // gathered here, and sent as far as the socket takes them without blocking.
+    std::string response;
+    auto last_send = std::chrono::steady_clock::now();
+    try {
+      searcher_->Search(
+          Query{.Root = std::filesystem::path{root}, .Needle = needle}, [&](const Match& match) {
+            response += match.Path(pathBuf, '\n');
+
+            const auto now = std::chrono::steady_clock::now();
+            if (response.size() >= kSendSize || now - last_send >= kSendInterval) {
+              last_send = now;
+              sendAvailable(connectionFd, response);
+            }
+          });
+    } catch (const std::system_error& ex) {
+      // The root couldn't be opened. That's the client's problem, not the connection's.
+      response = std::format("error: {}: {}\n", root, ex.what());
+    }
+
+    // The search is over, so we may take our time with whatever is left.
+    response += '\n';
+    sendAll(connectionFd, response);
+  }
+
+  /// @brief Sends as much of data as the socket takes without blocking, and drops that from it.
+  ///
+  /// @throws std::runtime_error, which drops the connection, if the client has fallen too far
+  ///         behind, or sending fails.
+  static void sendAvailable(int connectionFd, std::string& data) {
+    std::size_t sent_total = 0;
+    while (sent_total < data.size()) {
+      const ssize_t sent =
+          send(connectionFd, data.data() + sent_total, data.size() - sent_total, MSG_DONTWAIT);
+      if (sent == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        throw std::runtime_error(std::format("Failed to send: {}", std::strerror(errno)));
+      }
+      sent_total += static_cast<std::size_t>(sent);
+    }
+
+    data.erase(0, sent_total);
+    if (data.size() > kMaxUnsent) {
+      throw std::runtime_error("The client stopped reading its response.");
+    }
+  }
+
+  static void sendAll(int connectionFd, std::string_view data) {
+    while (!data.empty()) {
+      const ssize_t sent = write(connectionFd, data.data(), data.size());
+      if (sent == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(), "write");
+      }
+      data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+  }
+
+  std::filesystem::path socketPath_;
+  Searcher* searcher_;
+  int listenFd_ = -1;
+
+  std::atomic<std::uint32_t> connections_{0};
+};
+
+}  // namespace rbs
+
+#endif  // SERVE_HPP
@@ -70,8 +70,11 @@ public:
     return &new_node->Data;
   }
 
-  ~MPArena() {
-    Node* current = tail_.load(std::memory_order_acquire);
+  /// @brief Frees everything allocated so far.
+  ///
+  /// @note No other thread may be allocating, or still using anything we handed out.
+  void Reset() noexcept {
+    Node* current = tail_.exchange(nullptr, std::memory_order_acquire);
     while (current) {
       Node* to_delete = current;
       current = current->Previous;
@@ -79,6 +82,8 @@ public:
     }
   }
 
+  ~MPArena() { Reset(); }
+
 private:
   std::atomic<Node*> tail_ alignas(std::hardware_destructive_interference_size) = nullptr;
 };
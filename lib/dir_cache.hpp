@@ -0,0 +1,481 @@
+#ifndef RBS_DIR_CACHE_HPP
+#define RBS_DIR_CACHE_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.hpp"
+
+// Changes are watched for with inotify on Linux, and kqueue on macOS.
+#if defined(__linux__)
+#include <sys/inotify.h>
+#define RBS_DIR_CACHE_INOTIFY
+#elif defined(__APPLE__)
+#include <climits>
+#include <fcntl.h>
+#include <sys/event.h>
+#include <sys/resource.h>
+#define RBS_DIR_CACHE_KQUEUE
+#endif
+
+namespace rbs {
+
+/// @brief Directory listings kept across searches, so that searching a tree which hasn't changed
+///        doesn't read its directories again.
+///
+/// A listing is only cached once we are watching its directory for changes, which we do with
+/// inotify on Linux, and with kqueue on macOS. Elsewhere, nothing is ever cached.
+///
+/// Workers look up and insert listings concurrently during a search. Changes are only applied by
+/// Refresh, between searches, so a listing found during a search stays valid until it ends.
+///
+/// Every cached listing holds a watch, which is an inotify watch on Linux, and a descriptor on
+/// macOS. The number of listings is capped, so that a long-running server over a large tree neither
+/// grows without bound nor takes all of the user's watches or descriptors. Once the cache is full,
+/// further directories aren't cached, and Refresh evicts the listings used least recently to make
+/// room for the next search.
+class DirectoryCache {
+ private:
+  static constexpr Logger kLogger{"DirectoryCache"};
+
+  /// @brief Number of independently locked parts of the cache.
+  static constexpr std::size_t kShards = 64;
+
+#if defined(RBS_DIR_CACHE_INOTIFY)
+  /// @brief We leave at least half of the user's inotify watches to everyone else.
+  static constexpr std::size_t kWatchShareDivisor = 2;
+#elif defined(RBS_DIR_CACHE_KQUEUE)
+  /// @brief Each watch is a descriptor, and we leave most of them to searching.
+  static constexpr std::size_t kWatchShareDivisor = 4;
+#endif
+
+  /// @brief Refresh evicts down to all but this fraction of the capacity, leaving room for the
+  ///        next search.
+  static constexpr std::size_t kEvictDivisor = 8;
+
+ public:
+  /// @brief Identifies a directory regardless of the path it was reached through.
+  struct Key {
+    dev_t Device;
+    ino_t Inode;
+
+    [[nodiscard]] constexpr auto operator==(const Key&) const noexcept -> bool = default;
+  };
+
+  /// @brief The names and types of a directory's entries, without "." and "..".
+  class Listing {
+   public:
+    void Add(std::string_view name, std::uint8_t type) {
+      entries_.push_back(Entry{static_cast<std::uint32_t>(names_.size()),
+                               static_cast<std::uint32_t>(name.size()), type});
+      names_.append(name);
+    }
+
+    [[nodiscard]] constexpr auto Size() const noexcept -> std::size_t { return entries_.size(); }
+
+    [[nodiscard]] constexpr auto Name(std::size_t index) const noexcept -> std::string_view {
+      return std::string_view{names_}.substr(entries_[index].NameOffset,
+                                             entries_[index].NameLength);
+    }
+
+    [[nodiscard]] constexpr auto Type(std::size_t index) const noexcept -> std::uint8_t {
+      return entries_[index].Type;
+    }
+
+   private:
+    struct Entry {
+      std::uint32_t NameOffset;
+      std::uint32_t NameLength;
+      std::uint8_t Type;
+    };
+
+    // All names share one allocation.
+    std::string names_;
+    std::vector<Entry> entries_;
+  };
+
+  /// @param capacity The most listings to keep. Lowered to a share of the watches we may have.
+  explicit DirectoryCache(std::size_t capacity) noexcept : capacity_(capacity) {
+#if defined(RBS_DIR_CACHE_INOTIFY)
+    notifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd_ == -1) {
+      kLogger.Error(std::format("Failed to initialize inotify, directories won't be cached: {}",
+                                std::strerror(errno)));
+    }
+
+    std::ifstream max_watches_file{"/proc/sys/fs/inotify/max_user_watches"};
+    std::size_t max_watches = 0;
+    if (max_watches_file >> max_watches) {
+      capacity_ = std::min(capacity_, max_watches / kWatchShareDivisor);
+    }
+#elif defined(RBS_DIR_CACHE_KQUEUE)
+    notifyFd_ = kqueue();
+    if (notifyFd_ == -1) {
+      kLogger.Error(std::format("Failed to create a kqueue, directories won't be cached: {}",
+                                std::strerror(errno)));
+    }
+
+    // As far as FdBudget::FromRlimit raises the soft limit.
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+      const rlim_t max_fds = std::min<rlim_t>(limit.rlim_max, OPEN_MAX);
+      capacity_ = std::min<std::size_t>(capacity_, max_fds / kWatchShareDivisor);
+    }
+#endif
+  }
+
+  DirectoryCache(const DirectoryCache&) = delete;
+  DirectoryCache(DirectoryCache&&) = delete;
+  auto operator=(const DirectoryCache&) -> DirectoryCache& = delete;
+  auto operator=(DirectoryCache&&) -> DirectoryCache& = delete;
+
+  ~DirectoryCache() {
+#ifdef RBS_DIR_CACHE_KQUEUE
+    for (const auto& [watch, key] : watches_) {
+      close(watch);
+    }
+#endif
+    // Closing an inotify instance drops all of its watches.
+    if (notifyFd_ != -1) {
+      close(notifyFd_);
+    }
+  }
+
+  /// @brief Returns the cached listing of a directory, or nullptr.
+  [[nodiscard]] auto Find(const Key& key) const -> const Listing* {
+    const Shard& shard = shardFor(key);
+    const std::shared_lock lock{shard.Mutex};
+    const auto it = shard.Listings.find(key);
+    if (it == shard.Listings.end()) {
+      return nullptr;
+    }
+
+    it->second.LastUsed.store(epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return it->second.Contents.get();
+  }
+
+  /// @brief Starts watching a directory for changes. Returns the watch, or -1 if the directory
+  ///        can't be watched and so must not be cached.
+  ///
+  /// @note Call this before reading the directory, so that changes made while reading it aren't
+  ///       missed.
+  [[nodiscard]] auto Watch(int dirFd) noexcept -> int {
+    if (notifyFd_ == -1 || size_.load(std::memory_order_relaxed) >= capacity_ ||
+        watchesExhausted_.load(std::memory_order_relaxed)) {
+      return -1;
+    }
+
+    const int watch = addWatch(dirFd);
+    if (watch == -1 && outOfWatches(errno) && !watchesExhausted_.exchange(true)) {
+      // Everyone else on the machine needs watches too, so we back off until we free some up.
+      kLogger.Error("Ran out of watches, no more directories will be cached for now.");
+    }
+    return watch;
+  }
+
+  /// @brief Stops watching a directory which won't be cached after all, because its listing
+  ///        couldn't be read in full, or Insert turned it down.
+  void Unwatch(int watch) noexcept {
+    // With inotify, a directory reached through two paths, as with bind mounts, shares one watch.
+    // Keep it if the other one made it into the cache.
+    const std::lock_guard lock{watchesMutex_};
+    if (!watches_.contains(watch)) {
+      removeWatch(watch);
+    }
+  }
+
+  /// @brief Caches a directory's listing, read after calling Watch on it. Returns false if the
+  ///        listing wasn't cached, in which case the watch must be given back with Unwatch.
+  [[nodiscard]] auto Insert(const Key& key, int watch, Listing&& listing) -> bool {
+    if (size_.fetch_add(1, std::memory_order_relaxed) >= capacity_) {
+      size_.fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    {
+      Shard& shard = shardFor(key);
+      const std::lock_guard lock{shard.Mutex};
+      const auto [it, inserted] =
+          shard.Listings.try_emplace(key, std::make_unique<Listing>(std::move(listing)), watch,
+                                     epoch_.load(std::memory_order_relaxed));
+      if (!inserted) {
+        // Someone else got here through another path. With inotify, we share their watch.
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return it->second.Watch == watch;
+      }
+    }
+
+    const std::lock_guard lock{watchesMutex_};
+    watches_.insert_or_assign(watch, key);
+    return true;
+  }
+
+  /// @brief Drops the listings of every directory which changed since they were read, and makes
+  ///        room for the next search if the cache is close to full.
+  ///
+  /// @note No search may be running.
+  void Refresh() {
+    if (notifyFd_ == -1) {
+      return;
+    }
+
+    applyChanges();
+    evictLeastRecentlyUsed();
+    epoch_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  /// @brief A cached listing, and what we need to know to evict it.
+  struct Entry {
+    Entry(std::unique_ptr<Listing> contents, int watch, std::uint64_t lastUsed) noexcept
+        : Contents(std::move(contents)), Watch(watch), LastUsed(lastUsed) {}
+
+    std::unique_ptr<Listing> Contents;
+    int Watch;
+    /// @brief The last search to use this listing. Searches only ever read entries, so this is
+    ///        the one part of them which changes during a search.
+    mutable std::atomic<std::uint64_t> LastUsed;
+  };
+
+  struct KeyHash {
+    [[nodiscard]] auto operator()(const Key& key) const noexcept -> std::size_t {
+      return std::hash<ino_t>{}(key.Inode) ^ (std::hash<dev_t>{}(key.Device) << 1U);
+    }
+  };
+
+  struct alignas(std::hardware_destructive_interference_size) Shard {
+    mutable std::shared_mutex Mutex;
+    std::unordered_map<Key, Entry, KeyHash> Listings;
+  };
+
+  [[nodiscard]] auto shardFor(const Key& key) const noexcept -> const Shard& {
+    return shards_[KeyHash{}(key) % kShards];
+  }
+
+  [[nodiscard]] auto shardFor(const Key& key) noexcept -> Shard& {
+    return shards_[KeyHash{}(key) % kShards];
+  }
+
+#if defined(RBS_DIR_CACHE_INOTIFY)
+  [[nodiscard]] auto addWatch(int dirFd) const noexcept -> int {
+    // inotify only takes paths, but the directory may no longer be reachable through the path we
+    // found it by. Its descriptor always is.
+    std::array<char, 32> path{};
+    std::format_to_n(path.data(), path.size() - 1, "/proc/self/fd/{}", dirFd);
+
+    static constexpr std::uint32_t kMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                           IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    return inotify_add_watch(notifyFd_, path.data(), kMask);
+  }
+
+  [[nodiscard]] static constexpr auto outOfWatches(int error) noexcept -> bool {
+    return error == ENOSPC;
+  }
+
+  void removeWatch(int watch) const noexcept { inotify_rm_watch(notifyFd_, watch); }
+
+  void applyChanges() {
+    alignas(inotify_event) std::array<char, 16 * 1024> buf;
+    while (true) {
+      const ssize_t length = read(notifyFd_, buf.data(), buf.size());
+      if (length <= 0) {
+        // EAGAIN, there is nothing left to read.
+        return;
+      }
+
+      for (const char* ptr = buf.data(); ptr < buf.data() + length;) {
+        const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+        ptr += sizeof(inotify_event) + event->len;
+
+        if ((event->mask & IN_Q_OVERFLOW) != 0) {
+          // We lost track of what changed, so everything may have.
+          clear();
+          continue;
+        }
+
+        invalidate(event->wd, (event->mask & IN_IGNORED) != 0);
+      }
+    }
+  }
+#elif defined(RBS_DIR_CACHE_KQUEUE)
+  [[nodiscard]] auto addWatch(int dirFd) const noexcept -> int {
+    // A kqueue watch lasts as long as the descriptor it is on, so it needs one of its own.
+    // O_EVTONLY keeps it from holding up an unmount.
+    const int watch = openat(dirFd, ".", O_EVTONLY | O_DIRECTORY | O_CLOEXEC);
+    if (watch == -1) {
+      return -1;
+    }
+
+    // Creating, deleting or renaming an entry writes to the directory.
+    struct kevent change{};
+    EV_SET(&change, watch, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE, 0, nullptr);
+    if (kevent(notifyFd_, &change, 1, nullptr, 0, nullptr) == -1) {
+      const int kevent_errno = errno;
+      close(watch);
+      errno = kevent_errno;
+      return -1;
+    }
+    return watch;
+  }
+
+  [[nodiscard]] static constexpr auto outOfWatches(int error) noexcept -> bool {
+    return error == EMFILE || error == ENFILE;
+  }
+
+  // Closing the descriptor also drops its events.
+  void removeWatch(int watch) const noexcept { close(watch); }
+
+  void applyChanges() {
+    std::array<struct kevent, 256> events;
+    const timespec no_wait{};
+    while (true) {
+      const int count = kevent(notifyFd_, nullptr, 0, events.data(),
+                               static_cast<int>(events.size()), &no_wait);
+      for (int i = 0; i < count; ++i) {
+        invalidate(static_cast<int>(events[i].ident), false);
+      }
+
+      if (count < static_cast<int>(events.size())) {
+        // Either there is nothing left, or kevent failed, in which case we have no way to tell
+        // what changed.
+        if (count == -1) {
+          clear();
+        }
+        return;
+      }
+    }
+  }
+#else
+  [[nodiscard]] static constexpr auto addWatch(int /*unused*/) noexcept -> int { return -1; }
+
+  [[nodiscard]] static constexpr auto outOfWatches(int /*unused*/) noexcept -> bool {
+    return false;
+  }
+
+  static constexpr void removeWatch(int /*unused*/) noexcept {}
+
+  static constexpr void applyChanges() noexcept {}
+#endif
+
+  /// @brief Once the cache is nearly full, drops the listings which went unused the longest, so
+  ///        that the next search has room to cache what it reads.
+  void evictLeastRecentlyUsed() {
+    const std::size_t keep = capacity_ - capacity_ / kEvictDivisor;
+    const std::size_t size = size_.load(std::memory_order_relaxed);
+    if (size <= keep) {
+      return;
+    }
+
+    std::vector<std::pair<std::uint64_t, Key>> by_age;
+    by_age.reserve(size);
+    for (const Shard& shard : shards_) {
+      for (const auto& [key, entry] : shard.Listings) {
+        by_age.emplace_back(entry.LastUsed.load(std::memory_order_relaxed), key);
+      }
+    }
+
+    const std::size_t evict = by_age.size() - std::min(keep, by_age.size());
+    std::ranges::nth_element(by_age, by_age.begin() + static_cast<std::ptrdiff_t>(evict), {},
+                             &std::pair<std::uint64_t, Key>::first);
+    for (std::size_t i = 0; i < evict; ++i) {
+      erase(by_age[i].second);
+    }
+
+    // We gave some watches back, so there may be room for more.
+    watchesExhausted_.store(false, std::memory_order_relaxed);
+  }
+
+  void invalidate(int watch, bool removed) {
+    Key key{};
+    {
+      const std::lock_guard lock{watchesMutex_};
+      const auto it = watches_.find(watch);
+      if (it == watches_.end()) {
+        return;
+      }
+      key = it->second;
+
+      if (removed) {
+        // The kernel dropped the watch, most likely because the directory is gone. Its number
+        // may be reused for another directory, so it must not be removed again.
+        watches_.erase(it);
+      }
+    }
+
+    // The directory is read again, and watched anew, the next time a search gets to it. Until
+    // then, there is no point in watching it.
+    erase(key);
+  }
+
+  /// @brief Drops a listing, and its watch.
+  void erase(const Key& key) {
+    Shard& shard = shardFor(key);
+    int watch = -1;
+    {
+      const std::lock_guard lock{shard.Mutex};
+      const auto it = shard.Listings.find(key);
+      if (it == shard.Listings.end()) {
+        return;
+      }
+      watch = it->second.Watch;
+      shard.Listings.erase(it);
+      size_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    const std::lock_guard lock{watchesMutex_};
+    if (watches_.erase(watch) != 0) {
+      removeWatch(watch);
+    }
+  }
+
+  void clear() {
+    for (Shard& shard : shards_) {
+      const std::lock_guard lock{shard.Mutex};
+      shard.Listings.clear();
+    }
+    size_.store(0, std::memory_order_relaxed);
+
+    const std::lock_guard lock{watchesMutex_};
+    for (const auto& [watch, key] : watches_) {
+      removeWatch(watch);
+    }
+    watches_.clear();
+  }
+
+  std::array<Shard, kShards> shards_;
+  std::size_t capacity_;
+  std::atomic<std::size_t> size_{0};
+  /// @brief Bumped by every Refresh, and so once per search.
+  std::atomic<std::uint64_t> epoch_{0};
+  /// @brief Set once the kernel refuses to give us any more watches.
+  std::atomic<bool> watchesExhausted_{false};
+
+  std::mutex watchesMutex_;
+  std::unordered_map<int, Key> watches_;
+
+  /// @brief The inotify instance, or the kqueue.
+  int notifyFd_ = -1;
+};
+
+}  // namespace rbs
+
+#endif  // RBS_DIR_CACHE_HPP
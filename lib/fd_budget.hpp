@@ -0,0 +1,164 @@
+#ifndef RBS_FD_BUDGET_HPP
+#define RBS_FD_BUDGET_HPP
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <new>
+#include "log.hpp"
+
+namespace rbs {
+
+/// @brief Decides how many file descriptors the workers may keep open at once.
+///
+/// The ceiling comes from the process's RLIMIT_NOFILE, which we optionally raise at startup, and is
+/// capped well below what Linux usually allows. We never raise the limit past what the cap lets us
+/// use, since whatever we spawn inherits it. Below the ceiling, the target starts out modest and
+/// is driven by an additive-increase, multiplicative-decrease controller: it grows while searchers
+/// are starved for open files, and shrinks whenever the kernel refuses to give us another
+/// descriptor.
+class FdBudget final {
+ private:
+  static constexpr Logger kLogger{"FdBudget"};
+
+  /// @brief Descriptors we never hand out, for stdio, the allocator, and anything else libc needs.
+  static constexpr std::uint64_t kReservedFds = 64;
+
+  /// @brief The target never goes below this, so that we always make some progress.
+  static constexpr std::uint64_t kMinTarget = 16;
+
+  /// @brief Where the target starts. Every queued directory holds a DIR with a buffer of tens of
+  ///        KiB, so starting at the ceiling could take gigabytes before the first EMFILE ever
+  ///        makes us back off. The additive increase raises it when more are actually needed.
+  static constexpr std::uint64_t kInitialTarget = 4096;
+
+  /// @brief The target never goes above this, however high RLIMIT_NOFILE is, which bounds the
+  ///        memory held by open directories to a few hundred MiB.
+  static constexpr std::uint64_t kMaxTarget = 16384;
+
+ public:
+  explicit constexpr FdBudget(rlim_t softLimit, rlim_t hardLimit, bool raised) noexcept
+      : softLimit_(softLimit),
+        hardLimit_(hardLimit),
+        raised_(raised),
+        ceiling_(ceilingFor(softLimit)),
+        target_(std::min(ceiling_, kInitialTarget)) {}
+
+  /// @brief Builds a budget from the current RLIMIT_NOFILE, first raising the soft limit as far as
+  ///        the hard limit allows if requested, but no further than kMaxTarget needs.
+  [[nodiscard]] static auto FromRlimit(bool raise) noexcept -> FdBudget {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) [[unlikely]] {
+      kLogger.Error(std::format("Failed to query RLIMIT_NOFILE: {}", std::strerror(errno)));
+      // POSIX guarantees at least this many.
+      return FdBudget{_POSIX_OPEN_MAX, _POSIX_OPEN_MAX, false};
+    }
+
+    if (!raise || limit.rlim_cur >= limit.rlim_max) {
+      return FdBudget{limit.rlim_cur, limit.rlim_max, false};
+    }
+
+    rlim_t wanted = std::min<rlim_t>(limit.rlim_max, kMaxTarget + kReservedFds);
+#ifdef __APPLE__
+    // macOS reports an unlimited hard limit, but refuses soft limits above OPEN_MAX.
+    wanted = std::min<rlim_t>(wanted, OPEN_MAX);
+#endif
+
+    if (wanted <= limit.rlim_cur) {
+      return FdBudget{limit.rlim_cur, limit.rlim_max, false};
+    }
+
+    const rlimit raised{wanted, limit.rlim_max};
+    if (setrlimit(RLIMIT_NOFILE, &raised) != 0) {
+      kLogger.Error(std::format("Failed to raise RLIMIT_NOFILE to {}: {}", wanted,
+                                std::strerror(errno)));
+      return FdBudget{limit.rlim_cur, limit.rlim_max, false};
+    }
+
+    return FdBudget{wanted, limit.rlim_max, true};
+  }
+
+  /// @brief The number of descriptors we would like to have open.
+  [[nodiscard]] constexpr auto Target() const noexcept -> std::uint64_t {
+    return target_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief The most descriptors we will ever have open: what RLIMIT_NOFILE allows, up to
+  ///        kMaxTarget.
+  [[nodiscard]] constexpr auto Ceiling() const noexcept -> std::uint64_t { return ceiling_; }
+
+  [[nodiscard]] constexpr auto SoftLimit() const noexcept -> rlim_t { return softLimit_; }
+
+  [[nodiscard]] constexpr auto HardLimit() const noexcept -> rlim_t { return hardLimit_; }
+
+  [[nodiscard]] constexpr auto Raised() const noexcept -> bool { return raised_; }
+
+  [[nodiscard]] constexpr auto ExhaustedEvents() const noexcept -> std::uint64_t {
+    return exhaustedTotal_.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] constexpr auto Adjustments() const noexcept -> std::uint64_t {
+    return adjustments_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Records that an open failed with EMFILE or ENFILE.
+  constexpr void ReportExhausted() noexcept {
+    exhaustedPending_.fetch_add(1, std::memory_order_relaxed);
+    exhaustedTotal_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// @brief Runs one step of the controller.
+  ///
+  /// @param fdsOpen An estimate of the number of descriptors currently open.
+  /// @param searchBacklog The number of opened files waiting to be searched.
+  /// @param traverseBacklog The number of directories waiting to be traversed.
+  /// @param workers The number of workers consuming the backlogs.
+  constexpr void Adjust(std::uint64_t fdsOpen, std::size_t searchBacklog,
+                        std::size_t traverseBacklog, std::uint16_t workers) noexcept {
+    std::uint64_t target = target_.load(std::memory_order_relaxed);
+    std::uint64_t next = target;
+
+    if (exhaustedPending_.exchange(0, std::memory_order_relaxed) > 0) {
+      // The kernel refused to give us more descriptors, so whatever we believed the ceiling to be
+      // is wrong. Back off to well below what we actually had open.
+      next = std::max(kMinTarget, std::min(target, fdsOpen) * 3 / 4);
+    } else if (fdsOpen + workers >= target && searchBacklog < workers && traverseBacklog > 0) {
+      // We're pressed against the target, the searchers are running dry, and there is more to
+      // open. Give the traversers some room.
+      const std::uint64_t step = std::max<std::uint64_t>(workers, ceiling_ / 64);
+      next = std::min(ceiling_, target + step);
+    }
+
+    if (next != target &&
+        target_.compare_exchange_strong(target, next, std::memory_order_relaxed)) {
+      adjustments_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  [[nodiscard]] static constexpr auto ceilingFor(rlim_t softLimit) noexcept -> std::uint64_t {
+    if (softLimit <= kReservedFds * 2) {
+      return std::max<std::uint64_t>(kMinTarget, softLimit / 2);
+    }
+    return std::min<std::uint64_t>(softLimit - kReservedFds, kMaxTarget);
+  }
+
+  rlim_t softLimit_;
+  rlim_t hardLimit_;
+  bool raised_;
+  std::uint64_t ceiling_;
+
+  std::atomic<std::uint64_t> target_ alignas(std::hardware_destructive_interference_size);
+  std::atomic<std::uint64_t> exhaustedPending_{0};
+  std::atomic<std::uint64_t> exhaustedTotal_{0};
+  std::atomic<std::uint64_t> adjustments_{0};
+};
+
+}  // namespace rbs
+
+#endif  // RBS_FD_BUDGET_HPP
@@ -0,0 +1,323 @@
+#ifndef RBS_FILE_LIST_HPP
+#define RBS_FILE_LIST_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fs_node.hpp"
+#include "jobs/search_file_job.hpp"
+#include "log.hpp"
+
+namespace rbs {
+
+/// @brief Reads a list of paths from a descriptor, a batch at a time, without reading all of it
+///        first.
+///
+/// Paths are separated by NUL, as with `git ls-files -z` or `find -print0`, or by newlines,
+/// whichever ends the first path. A newline in a NUL-separated list is part of a name.
+class FileListReader {
+ private:
+  static constexpr std::size_t kReadSize = 64ULL * 1024ULL;
+
+ public:
+  explicit FileListReader(int fileDesc) : fd_(fileDesc), buffer_(kReadSize) {}
+
+  /// @brief Appends up to maxPaths paths to paths. Returns false once the list is exhausted.
+  ///
+  /// Only blocks until at least one path has arrived, so that the paths of a slow producer are
+  /// searched as they come in, rather than once a whole batch has.
+  ///
+  /// @throws std::system_error if reading fails.
+  auto ReadBatch(std::vector<std::string>& paths, std::size_t maxPaths) -> bool {
+    const std::size_t initial = paths.size();
+    while (paths.size() - initial < maxPaths) {
+      const std::size_t end = pending_.find(delimiter_, parsed_);
+      if (end != std::string::npos) {
+        addPath(paths, std::string_view{pending_}.substr(parsed_, end - parsed_));
+        parsed_ = end + 1;
+        continue;
+      }
+
+      if (endOfFile_) {
+        // The last path needn't be terminated.
+        addPath(paths, std::string_view{pending_}.substr(parsed_));
+        pending_.clear();
+        parsed_ = 0;
+        break;
+      }
+
+      if (paths.size() > initial) {
+        // Reading more might mean waiting on the producer.
+        break;
+      }
+
+      fill();
+    }
+
+    return paths.size() > initial || !endOfFile_;
+  }
+
+ private:
+  void fill() {
+    pending_.erase(0, parsed_);
+    parsed_ = 0;
+
+    ssize_t length = 0;
+    do {
+      length = read(fd_, buffer_.data(), buffer_.size());
+    } while (length == -1 && errno == EINTR);
+
+    if (length == -1) {
+      throw std::system_error(errno, std::generic_category(), "Failed to read the file list");
+    }
+
+    if (length == 0) {
+      endOfFile_ = true;
+      return;
+    }
+
+    const std::string_view chunk{buffer_.data(), static_cast<std::size_t>(length)};
+    if (!delimiterKnown_) {
+      // A read may end anywhere, even in the middle of the first path, so we can only tell once
+      // we see it end. Until then, neither delimiter is pending, so no path is split too early.
+      const std::size_t end = chunk.find_first_of(std::string_view{"\0\n", 2});
+      if (end != std::string_view::npos) {
+        delimiter_ = chunk[end];
+        delimiterKnown_ = true;
+      }
+    }
+    pending_.append(chunk);
+  }
+
+  void addPath(std::vector<std::string>& paths, std::string_view path) const {
+    // Lists written on Windows end their lines with CRLF.
+    if (delimiter_ == '\n' && path.ends_with('\r')) {
+      path.remove_suffix(1);
+    }
+    if (!path.empty()) {
+      paths.emplace_back(path);
+    }
+  }
+
+  int fd_;
+  std::vector<char> buffer_;
+  std::string pending_;
+  std::size_t parsed_ = 0;
+  char delimiter_ = '\n';
+  bool delimiterKnown_ = false;
+  bool endOfFile_ = false;
+};
+
+/// @brief Opens listed files and submits them straight to the search queue, so that nothing has
+///        to be traversed.
+///
+/// Each batch is sorted, which groups the files by directory, so that every directory is opened
+/// once per batch and its files are opened relative to it. Lists which are sorted already, such as
+/// those from `git ls-files`, open every directory once overall.
+template <class Scheduler>
+class FileListSubmitter {
+ private:
+  static constexpr Logger kLogger{"FileListSubmitter"};
+
+  /// @brief How many jobs we hand the scheduler at once.
+  static constexpr std::size_t kSubmitBatchSize = 64;
+
+  /// @brief How long we wait for the workers to close some files once we reach the budget.
+  static constexpr auto kFdWaitInterval = std::chrono::microseconds(50);
+
+ public:
+  /// @param rootFd The directory relative paths are resolved against. We don't take ownership.
+  FileListSubmitter(Scheduler& scheduler, int rootFd) : scheduler_(&scheduler), rootFd_(rootFd) {
+    jobs_.reserve(kSubmitBatchSize);
+  }
+
+  /// @brief Opens and submits every regular file in paths. Paths are reordered.
+  void Submit(std::vector<std::string>& paths) {
+    std::ranges::sort(paths, [](std::string_view lhs, std::string_view rhs) {
+      return std::pair{parentOf(lhs), lhs} < std::pair{parentOf(rhs), rhs};
+    });
+
+    for (auto group_begin = paths.begin(); group_begin != paths.end();) {
+      const std::string_view parent = parentOf(*group_begin);
+      const auto group_end = std::find_if(group_begin, paths.end(),
+                                          [parent](std::string_view path) {
+                                            return parentOf(path) != parent;
+                                          });
+
+      submitGroup(parent, std::span{group_begin, group_end});
+      group_begin = group_end;
+    }
+
+    flush();
+  }
+
+ private:
+  /// @brief Returns everything before the last separator, or nothing for a bare name.
+  [[nodiscard]] static constexpr auto parentOf(std::string_view path) noexcept
+      -> std::string_view {
+    const std::size_t separator = path.rfind('/');
+    if (separator == std::string_view::npos) {
+      return {};
+    }
+    // Files directly in / keep their separator, or they would look relative.
+    return path.substr(0, std::max<std::size_t>(separator, 1));
+  }
+
+  void submitGroup(std::string_view parent, std::span<const std::string> paths) {
+    int dir_fd = rootFd_;
+    if (!parent.empty()) {
+      const std::string parent_str{parent};
+      dir_fd = openAt(rootFd_, parent_str.c_str(), O_RDONLY | O_DIRECTORY);
+      if (dir_fd == -1) {
+        kLogger.Error(
+            std::format("Failed to open directory {}: {}", parent, std::strerror(errno)));
+        return;
+      }
+    }
+
+    FsNode* parent_node = nodeFor(parent);
+    for (const std::string& path : paths) {
+      // npos + 1 wraps around to the start of a bare name.
+      submitFile(dir_fd, parent_node, std::string_view{path}.substr(path.rfind('/') + 1));
+    }
+
+    if (dir_fd != rootFd_) {
+      close(dir_fd);
+    }
+  }
+
+  void submitFile(int dirFd, FsNode* parentNode, std::string_view name) {
+    waitForFdBudget();
+
+    const std::string name_str{name};
+    scheduler_->SlowOpenFile();
+    const int file_fd = openAt(dirFd, name_str.c_str(), O_RDONLY);
+    if (file_fd == -1) [[unlikely]] {
+      scheduler_->SlowFinishVisitingFile();
+      kLogger.Error(std::format("Failed to open file {}: {}", name, std::strerror(errno)));
+      return;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode) ||
+        file_stat.st_size == 0) {
+      // Directories and the like may be listed too, but we only search regular files. Nothing to
+      // search in an empty file either.
+      close(file_fd);
+      scheduler_->SlowFinishVisitingFile();
+      return;
+    }
+
+    FsNode* node = scheduler_->FsNodeArena()->UnfencedAlloc();
+    if (node == nullptr) {
+      kLogger.Error("Failed to allocate memory for Directory object. This is a bug.");
+      std::terminate();
+    }
+    AssignEntry(*node, name, DT_REG, parentNode);
+
+    jobs_.emplace_back(node, file_fd, static_cast<std::size_t>(file_stat.st_size));
+    if (jobs_.size() == kSubmitBatchSize) {
+      flush();
+    }
+  }
+
+  void flush() {
+    if (!jobs_.empty()) {
+      scheduler_->SlowSubmit(jobs_);
+      jobs_.clear();
+    }
+  }
+
+  /// @brief Holds off opening more files while the workers already have as many open as the
+  ///        budget allows.
+  void waitForFdBudget() {
+    if (scheduler_->FdsCurrentlyOpen() < scheduler_->FdBudget().Target()) [[likely]] {
+      return;
+    }
+
+    // The files we are holding on to count towards the budget too, and only the workers can
+    // close them.
+    flush();
+    while (scheduler_->FdsCurrentlyOpen() >= scheduler_->FdBudget().Target()) {
+      std::this_thread::sleep_for(kFdWaitInterval);
+    }
+  }
+
+  /// @brief openat(2), except that running out of descriptors is reported to the budget, and
+  ///        retried once the workers have closed some.
+  auto openAt(int dirFd, const char* name, int flags) -> int {
+    while (true) {
+      const int file_desc = openat(dirFd, name, flags | O_CLOEXEC);
+      if (file_desc != -1 || (errno != EMFILE && errno != ENFILE)) [[likely]] {
+        return file_desc;
+      }
+
+      const int open_errno = errno;
+      scheduler_->ReportFdsExhausted();
+      flush();
+      if (scheduler_->FdsCurrentlyOpen() == 0) {
+        // Nobody is going to close anything, so waiting won't help.
+        errno = open_errno;
+        return -1;
+      }
+      std::this_thread::sleep_for(kFdWaitInterval);
+    }
+  }
+
+  /// @brief Returns the node of a directory, creating it and its ancestors on first use. The
+  ///        root has no node, like when traversing.
+  auto nodeFor(std::string_view dir) -> FsNode* {
+    if (dir.empty()) {
+      return nullptr;
+    }
+
+    const auto cached = dirNodes_.find(std::string{dir});
+    if (cached != dirNodes_.end()) {
+      return cached->second;
+    }
+
+    const std::size_t separator = dir.rfind('/');
+    FsNode* parent = nodeFor(separator == std::string_view::npos ? std::string_view{}
+                                                                 : dir.substr(0, separator));
+    const std::string_view name =
+        separator == std::string_view::npos ? dir : dir.substr(separator + 1);
+
+    // Paths like "./a" or "a//b" have components which name no directory of their own.
+    FsNode* node = parent;
+    if (!name.empty() && name != ".") {
+      node = scheduler_->FsNodeArena()->UnfencedAlloc();
+      if (node == nullptr) {
+        kLogger.Error("Failed to allocate memory for Directory object. This is a bug.");
+        std::terminate();
+      }
+      AssignEntry(*node, name, DT_DIR, parent);
+    }
+
+    dirNodes_.emplace(dir, node);
+    return node;
+  }
+
+  Scheduler* scheduler_;
+  int rootFd_;
+  std::vector<SearchFileJob> jobs_;
+  std::unordered_map<std::string, FsNode*> dirNodes_;
+};
+
+}  // namespace rbs
+
+#endif  // RBS_FILE_LIST_HPP
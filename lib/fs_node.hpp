@@ -0,0 +1,46 @@
+#ifndef RBS_FS_NODE_HPP
+#define RBS_FS_NODE_HPP
+
+#include <dirent.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace rbs {
+
+struct FsNode {
+  dirent Entry;
+  FsNode* Parent;
+};
+
+/// @brief Returns the name of a directory entry.
+///
+/// BSDs and macOS store the length in d_namlen. glibc has no such field, and _D_EXACT_NAMLEN falls
+/// back to strlen.
+[[nodiscard]] constexpr auto EntryName(const dirent& entry) noexcept -> std::string_view {
+#ifdef _D_EXACT_NAMLEN
+  return {entry.d_name, _D_EXACT_NAMLEN(&entry)};
+#else
+  return {entry.d_name, entry.d_namlen};
+#endif
+}
+
+/// @brief Fills in the entry of a node which did not come from readdir.
+///
+/// Names longer than a dirent can hold are truncated.
+constexpr void AssignEntry(FsNode& node, std::string_view name, std::uint8_t type,
+                           FsNode* parent) noexcept {
+  const std::size_t length = std::min(name.size(), sizeof(node.Entry.d_name) - 1);
+  std::copy_n(name.data(), length, node.Entry.d_name);
+  node.Entry.d_name[length] = '\0';
+#ifndef _D_EXACT_NAMLEN
+  node.Entry.d_namlen = static_cast<decltype(node.Entry.d_namlen)>(length);
+#endif
+  node.Entry.d_type = type;
+  node.Parent = parent;
+}
+
+}  // namespace rbs
+
+#endif  // RBS_FS_NODE_HPP
@@ -0,0 +1,42 @@
+#ifndef RBS_IO_ADVISE_HPP
+#define RBS_IO_ADVISE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+
+namespace rbs::io {
+
+/// @brief Asks the kernel to start reading the first @p length bytes of a file into the page
+///        cache, without waiting for it to happen.
+inline void AdviseWillNeed(int fileDesc, std::size_t length) noexcept {
+#if defined(__linux__)
+  posix_fadvise(fileDesc, 0, static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+#elif defined(__APPLE__)
+  radvisory advice{
+      .ra_offset = 0,
+      .ra_count = static_cast<int>(std::min<std::size_t>(length, INT_MAX)),
+  };
+  fcntl(fileDesc, F_RDADVISE, &advice);
+#else
+  (void)fileDesc;
+  (void)length;
+#endif
+}
+
+/// @brief Asks the kernel to start faulting in a page-aligned range of a mapping.
+inline void AdviseWillNeed(const void* address, std::size_t length) noexcept {
+  madvise(const_cast<void*>(address), length, MADV_WILLNEED);
+}
+
+/// @brief Tells the kernel a mapping will be read front to back, so that it reads ahead
+///        aggressively and drops pages behind us.
+inline void AdviseSequential(const void* address, std::size_t length) noexcept {
+  madvise(const_cast<void*>(address), length, MADV_SEQUENTIAL);
+}
+
+}  // namespace rbs::io
+
+#endif  // RBS_IO_ADVISE_HPP
@@ -0,0 +1,188 @@
+#ifndef RBS_IO_DECOMPRESS_HPP
+#define RBS_IO_DECOMPRESS_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#ifdef RBS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef RBS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace rbs::io {
+
+enum class Compression : std::uint8_t {
+  None,
+  Gzip,
+  Zstd,
+};
+
+inline constexpr std::array<std::uint8_t, 2> kGzipMagic{0x1f, 0x8b};
+inline constexpr std::array<std::uint8_t, 4> kZstdMagic{0x28, 0xb5, 0x2f, 0xfd};
+
+/// @brief Tells which format a file is compressed with from its first bytes.
+[[nodiscard]] constexpr auto DetectCompression(std::span<const char> head) noexcept
+    -> Compression {
+  const auto starts_with = [head](std::span<const std::uint8_t> magic) {
+    return head.size() >= magic.size() &&
+           std::ranges::equal(head.first(magic.size()), magic, {},
+                              [](char byte) { return static_cast<std::uint8_t>(byte); });
+  };
+
+  if (starts_with(kGzipMagic)) {
+    return Compression::Gzip;
+  }
+  if (starts_with(kZstdMagic)) {
+    return Compression::Zstd;
+  }
+  return Compression::None;
+}
+
+/// @brief Streaming decompression of one file at a time.
+///
+/// Each worker keeps one of these, so that the decoders' state is only allocated once. Nothing is
+/// allocated until the first file of each format.
+class Decompressor {
+ public:
+  /// @brief The outcome of a single Decompress call.
+  struct Step {
+    /// @brief Bytes of input used up.
+    std::size_t Consumed = 0;
+    /// @brief Bytes of output written.
+    std::size_t Produced = 0;
+    /// @brief Whether the input is corrupt. Nothing more should be decompressed.
+    bool Failed = false;
+  };
+
+  Decompressor() noexcept = default;
+
+  Decompressor(const Decompressor&) = delete;
+  Decompressor(Decompressor&&) = delete;
+  auto operator=(const Decompressor&) -> Decompressor& = delete;
+  auto operator=(Decompressor&&) -> Decompressor& = delete;
+
+  ~Decompressor() {
+#ifdef RBS_HAVE_ZLIB
+    if (zlibReady_) {
+      inflateEnd(&zlib_);
+    }
+#endif
+#ifdef RBS_HAVE_ZSTD
+    ZSTD_freeDCtx(zstd_);
+#endif
+  }
+
+  /// @brief Gets ready to decompress a new stream. Returns false if that's not possible, in which
+  ///        case the stream must be searched as it is.
+  [[nodiscard]] auto Reset(Compression compression) noexcept -> bool {
+    compression_ = compression;
+    switch (compression) {
+#ifdef RBS_HAVE_ZLIB
+      case Compression::Gzip: {
+        if (zlibReady_) {
+          return inflateReset(&zlib_) == Z_OK;
+        }
+
+        // The extra 16 tells zlib to expect a gzip header rather than a zlib one.
+        static constexpr int kGzipWindowBits = 15 + 16;
+        zlib_ = z_stream{};
+        zlibReady_ = inflateInit2(&zlib_, kGzipWindowBits) == Z_OK;
+        return zlibReady_;
+      }
+#endif
+#ifdef RBS_HAVE_ZSTD
+      case Compression::Zstd: {
+        if (zstd_ == nullptr) {
+          zstd_ = ZSTD_createDCtx();
+          return zstd_ != nullptr;
+        }
+        return ZSTD_isError(ZSTD_DCtx_reset(zstd_, ZSTD_reset_session_only)) == 0U;
+      }
+#endif
+      default:
+        return false;
+    }
+  }
+
+  /// @brief Decompresses as much of the input as fits into the output.
+  ///
+  /// Output may still be pending after all of the input is consumed, so call this with an empty
+  /// input once there is no more, until nothing is produced.
+  [[nodiscard]] auto Decompress(std::span<const char> input, std::span<char> output) noexcept
+      -> Step {
+    switch (compression_) {
+#ifdef RBS_HAVE_ZLIB
+      case Compression::Gzip:
+        return inflateStep(input, output);
+#endif
+#ifdef RBS_HAVE_ZSTD
+      case Compression::Zstd:
+        return zstdStep(input, output);
+#endif
+      default:
+        return Step{.Failed = true};
+    }
+  }
+
+ private:
+#ifdef RBS_HAVE_ZLIB
+  auto inflateStep(std::span<const char> input, std::span<char> output) noexcept -> Step {
+    // zlib's interface predates const, but doesn't write to the input.
+    zlib_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zlib_.avail_in = static_cast<uInt>(input.size());
+    zlib_.next_out = reinterpret_cast<Bytef*>(output.data());
+    zlib_.avail_out = static_cast<uInt>(output.size());
+
+    const int status = inflate(&zlib_, Z_NO_FLUSH);
+    Step step{
+        .Consumed = input.size() - zlib_.avail_in,
+        .Produced = output.size() - zlib_.avail_out,
+    };
+
+    if (status == Z_STREAM_END) {
+      // Rotated logs are often several gzip members back to back, which gunzip reads as one.
+      step.Failed = inflateReset(&zlib_) != Z_OK;
+    } else if (status != Z_OK && status != Z_BUF_ERROR) {
+      // Z_BUF_ERROR only means no progress was possible, which the caller sees anyway.
+      step.Failed = true;
+    }
+    return step;
+  }
+#endif
+
+#ifdef RBS_HAVE_ZSTD
+  auto zstdStep(std::span<const char> input, std::span<char> output) noexcept -> Step {
+    ZSTD_inBuffer in{input.data(), input.size(), 0};
+    ZSTD_outBuffer out{output.data(), output.size(), 0};
+
+    // This carries on into the next frame by itself.
+    const std::size_t status = ZSTD_decompressStream(zstd_, &out, &in);
+    return Step{
+        .Consumed = in.pos,
+        .Produced = out.pos,
+        .Failed = ZSTD_isError(status) != 0U,
+    };
+  }
+#endif
+
+  Compression compression_ = Compression::None;
+
+#ifdef RBS_HAVE_ZLIB
+  z_stream zlib_{};
+  bool zlibReady_ = false;
+#endif
+
+#ifdef RBS_HAVE_ZSTD
+  ZSTD_DCtx* zstd_ = nullptr;
+#endif
+};
+
+}  // namespace rbs::io
+
+#endif  // RBS_IO_DECOMPRESS_HPP
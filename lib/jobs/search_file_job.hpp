@@ -0,0 +1,367 @@
+#ifndef RBS_SEARCH_FILE_JOB_HPP
+#define RBS_SEARCH_FILE_JOB_HPP
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "fs_node.hpp"
+#include "io/advise.hpp"
+#include "io/decompress.hpp"
+#include "log.hpp"
+#include "result.hpp"
+#include "search_kernel.hpp"
+#include "stats.hpp"
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace rbs {
+
+class SearchFileJob final {
+private:
+  static constexpr Logger kLogger{"SearchFileJob"};
+
+  template <class Worker>
+  class FdCloser {
+  public:
+    explicit FdCloser(int fileDesc, Worker& worker) noexcept : fd_(fileDesc), worker_(&worker) {}
+
+    ~FdCloser() noexcept {
+      close(fd_);
+      worker_->FinishVisitingFile();
+    }
+
+  private:
+    int fd_;
+    Worker* worker_;
+  };
+
+  static constexpr std::size_t kKiB = 1024;
+  static constexpr std::size_t kMiB = 1024 * kKiB;
+
+  /// @brief How much of a file Prefetch asks for. Searches stop at the first match, so reading all
+  ///        of a huge file up front could be wasted. The rest is read ahead as we scan.
+  static constexpr std::size_t kPrefetchLength = 4 * kMiB;
+
+  /// @brief Large mappings are scanned in chunks of this size, asking for the next chunk before
+  ///        scanning the current one. Must be a multiple of the page size.
+  static constexpr std::size_t kScanChunkLength = 4 * kMiB;
+
+  /// @brief How searching a file through its decompressor went.
+  enum class DecompressedSearch : std::uint8_t {
+    Found,
+    NotFound,
+    /// @brief The file couldn't be decompressed, or there was no memory to, so it wasn't
+    ///        searched in full.
+    Failed,
+  };
+
+public:
+  /// @brief Number of size classes search jobs are bucketed into.
+  static constexpr std::size_t kSizeClasses = 4;
+
+  /// @brief Smallest file size belonging to each size class but the last, largest class first.
+  static constexpr std::array<std::size_t, kSizeClasses - 1> kSizeClassThresholds{
+    16 * kMiB, 1 * kMiB, 64 * kKiB};
+
+  constexpr SearchFileJob() noexcept = default;
+
+  explicit constexpr SearchFileJob(
+    FsNode* fsNode,
+    int fileDescriptor,
+    std::size_t fileSize
+  ) noexcept : fsNode_(fsNode), fd_(fileDescriptor), size_(fileSize) {}
+
+  template <class Worker>
+  constexpr void Service(Worker& worker) noexcept {
+    FdCloser closer{fd_, worker};
+
+    if (size_ == 0) {
+      return;
+    }
+
+    const std::string_view needle = Needle(worker);
+    const std::span<char> read_buffer = worker.ReadBuffer();
+
+    bool found = false;
+    if (worker.SearchCompressed()) {
+      found = searchMaybeCompressed(worker, read_buffer, needle);
+    } else if (size_ <= read_buffer.size()) {
+      // Small files are cheaper to copy than to map, since mapping and unmapping cost page table
+      // updates and TLB shootdowns on every core running one of our threads.
+      found = searchRead(worker, read_buffer, needle);
+    } else {
+      found = searchMapped(worker, needle);
+    }
+
+    if (found) {
+      worker.PushResult(Result{fsNode_});
+    }
+  }
+
+  /// @brief Has the kernel start reading the file in the background, so that by the time we get
+  ///        around to searching it, it is hopefully cached.
+  constexpr void Prefetch() const noexcept {
+    io::AdviseWillNeed(fd_, std::min(size_, kPrefetchLength));
+  }
+
+  template <class Worker>
+  [[nodiscard]] constexpr auto Needle(const Worker& worker) -> std::string_view {
+    // TODO(marko): yucky hack
+    return worker.SearchString();
+  }
+
+  [[nodiscard]] constexpr auto Exists() const noexcept -> bool {
+    return fsNode_ != nullptr;
+  }
+
+  [[nodiscard]] constexpr auto Size() const noexcept -> std::size_t {
+    return size_;
+  }
+
+  /// @brief Returns the size class of this job. Class 0 holds the largest files.
+  [[nodiscard]] constexpr auto SizeClass() const noexcept -> std::size_t {
+    for (std::size_t size_class = 0; size_class < kSizeClassThresholds.size(); ++size_class) {
+      if (size_ >= kSizeClassThresholds[size_class]) {
+        return size_class;
+      }
+    }
+    return kSizeClasses - 1;
+  }
+
+private:
+  /// @brief The file's path, for error messages, or just its name if the path is too long.
+  [[nodiscard]] auto pathForLog() const -> std::string {
+    std::array<char, PATH_MAX> buffer;
+    try {
+      std::string_view path = Result{fsNode_}.ComputePathStr(buffer, '\0');
+      path.remove_suffix(1);
+      return std::string{path};
+    } catch (const std::runtime_error&) {
+      return std::string{EntryName(fsNode_->Entry)};
+    }
+  }
+
+  /// @brief Reads from the file at the given offset until the buffer is full or the file ends.
+  ///        Returns the number of bytes read, or -1.
+  [[nodiscard]] auto readAt(std::span<char> buffer, std::size_t offset) const noexcept
+      -> ssize_t {
+    std::size_t length = 0;
+    while (length < buffer.size()) {
+      const ssize_t bytes_read = pread(fd_, buffer.data() + length, buffer.size() - length,
+                                       static_cast<off_t>(offset + length));
+      if (bytes_read == -1) [[unlikely]] {
+        if (errno == EINTR) {
+          continue;
+        }
+        kLogger.Error(std::format("Failed to read file: {}", std::strerror(errno)));
+        return -1;
+      }
+
+      if (bytes_read == 0) {
+        // The file shrank since we looked at it.
+        break;
+      }
+
+      length += static_cast<std::size_t>(bytes_read);
+    }
+    return static_cast<ssize_t>(length);
+  }
+
+  template <class Worker>
+  [[nodiscard]] constexpr auto searchRead(Worker& worker, std::span<char> buffer,
+                                          std::string_view needle) const noexcept -> bool {
+    worker.Stats().Add(stats::Counter::FilesRead);
+
+    const ssize_t length = readAt(buffer.first(size_), 0);
+    if (length == -1) [[unlikely]] {
+      return false;
+    }
+
+    worker.Stats().Add(stats::Counter::BytesScanned, static_cast<std::size_t>(length));
+    return ContainsNeedle({buffer.data(), static_cast<std::size_t>(length)}, needle);
+  }
+
+  /// @brief Searches a file which may be compressed. Which it is, we only know once we have read
+  ///        its first bytes, so we read as much of it as fits into the buffer up front.
+  template <class Worker>
+  [[nodiscard]] constexpr auto searchMaybeCompressed(Worker& worker, std::span<char> buffer,
+                                                     std::string_view needle) const noexcept
+      -> bool {
+    const ssize_t length = readAt(buffer.first(std::min(size_, buffer.size())), 0);
+    if (length == -1) [[unlikely]] {
+      return false;
+    }
+
+    const std::span<char> head = buffer.first(static_cast<std::size_t>(length));
+    const io::Compression compression = io::DetectCompression(head);
+    if (compression != io::Compression::None && worker.Decompressor().Reset(compression)) {
+      const DecompressedSearch outcome = searchDecompressed(worker, buffer, head.size(), needle);
+      if (outcome != DecompressedSearch::Failed) {
+        return outcome == DecompressedSearch::Found;
+      }
+
+      // Starting with a compression format's magic number may be a coincidence, and a damaged
+      // archive may still hold the needle verbatim. Either way, or if there was no memory to
+      // decompress into, we search the raw bytes like any other file. Decompressing overwrote the
+      // buffer, so they are read again.
+      return size_ <= buffer.size() ? searchRead(worker, buffer, needle)
+                                    : searchMapped(worker, needle);
+    }
+
+    if (size_ <= buffer.size()) {
+      // We already have all of it.
+      worker.Stats().Add(stats::Counter::FilesRead);
+      worker.Stats().Add(stats::Counter::BytesScanned, head.size());
+      return ContainsNeedle({head.data(), head.size()}, needle);
+    }
+
+    return searchMapped(worker, needle);
+  }
+
+  /// @brief Streams the file through the worker's decompressor, searching each window of output
+  ///        as it is produced. The file is never decompressed as a whole, and we stop at the first
+  ///        match.
+  ///
+  /// @param buffered How much of the start of the file is already in the input buffer.
+  template <class Worker>
+  [[nodiscard]] constexpr auto searchDecompressed(Worker& worker, std::span<char> input,
+                                                  std::size_t buffered,
+                                                  std::string_view needle) const noexcept
+      -> DecompressedSearch {
+    // A match may straddle two windows, so the end of each window is carried over to the start of
+    // the next one.
+    const std::size_t overlap = needle.empty() ? 0 : needle.size() - 1;
+    const std::span<char> window = worker.DecompressWindow(overlap);
+    if (window.empty()) [[unlikely]] {
+      return DecompressedSearch::Failed;
+    }
+
+    worker.Stats().Add(stats::Counter::FilesDecompressed);
+
+    io::Decompressor& decompressor = worker.Decompressor();
+
+    std::size_t file_offset = buffered;
+    std::size_t input_begin = 0;
+    std::size_t input_end = buffered;
+    bool end_of_file = false;
+    std::size_t carried = 0;
+
+    while (true) {
+      if (input_begin == input_end && !end_of_file) {
+        const ssize_t bytes_read = readAt(input, file_offset);
+        if (bytes_read == -1) [[unlikely]] {
+          return DecompressedSearch::NotFound;
+        }
+
+        input_begin = 0;
+        input_end = static_cast<std::size_t>(bytes_read);
+        file_offset += input_end;
+        end_of_file = input_end == 0;
+      }
+
+      const io::Decompressor::Step step = decompressor.Decompress(
+          std::span<const char>{input}.subspan(input_begin, input_end - input_begin),
+          window.subspan(carried));
+      input_begin += step.Consumed;
+
+      if (step.Produced > 0) {
+        worker.Stats().Add(stats::Counter::BytesScanned, step.Produced);
+
+        const std::size_t length = carried + step.Produced;
+        if (ContainsNeedle({window.data(), length}, needle)) {
+          return DecompressedSearch::Found;
+        }
+
+        carried = std::min(overlap, length);
+        std::copy(window.begin() + static_cast<std::ptrdiff_t>(length - carried),
+                  window.begin() + static_cast<std::ptrdiff_t>(length), window.begin());
+      }
+
+      if (step.Failed) [[unlikely]] {
+        kLogger.Error(std::format(
+            "Failed to decompress {}, it may be corrupt or not compressed at all. Searching it "
+            "as is.",
+            pathForLog()));
+        return DecompressedSearch::Failed;
+      }
+
+      if (step.Produced == 0 && step.Consumed == 0 && (end_of_file || input_begin != input_end)) {
+        // Either we are done, or the decompressor is stuck on input it can't use. A truncated
+        // file ends up here too, and we have searched everything it had.
+        return DecompressedSearch::NotFound;
+      }
+    }
+  }
+
+  template <class Worker>
+  [[nodiscard]] constexpr auto searchMapped(Worker& worker,
+                                            std::string_view needle) const noexcept -> bool {
+    worker.Stats().Add(stats::Counter::FilesMapped);
+
+    // TODO(marko): Is there value in adding MAP_NOCACHE?
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (data == MAP_FAILED) {
+      kLogger.Error(std::format("Failed to map file into memory: {}", std::strerror(errno)));
+      return false;
+    }
+
+    const char* bytes = static_cast<const char*>(data);
+    bool found = false;
+    if (size_ < kSizeClassThresholds.front()) {
+      // Medium files are scanned in one go, with the kernel asked to read all of them ahead of
+      // us. Unlike prefaulting, that doesn't hold us up until the last page is in. We don't do
+      // this to the largest files, since a match near the start would make reading the rest a
+      // waste.
+      io::AdviseSequential(bytes, size_);
+      io::AdviseWillNeed(bytes, size_);
+      worker.Stats().Add(stats::Counter::BytesScanned, size_);
+      found = ContainsNeedle({bytes, size_}, needle);
+    } else {
+      found = searchChunked(worker, bytes, needle);
+    }
+
+    munmap(data, size_);
+    return found;
+  }
+
+  template <class Worker>
+  [[nodiscard]] constexpr auto searchChunked(Worker& worker, const char* bytes,
+                                             std::string_view needle) const noexcept -> bool {
+    io::AdviseSequential(bytes, size_);
+
+    // A match may straddle two chunks, so each chunk is searched together with the start of the
+    // next one.
+    const std::size_t overlap = needle.empty() ? 0 : needle.size() - 1;
+
+    for (std::size_t offset = 0; offset < size_; offset += kScanChunkLength) {
+      const std::size_t next_offset = offset + kScanChunkLength;
+      if (next_offset < size_) {
+        // Get the disk working on the next chunk while we scan this one.
+        io::AdviseWillNeed(bytes + next_offset, std::min(kScanChunkLength, size_ - next_offset));
+      }
+
+      const std::size_t end = std::min(size_, next_offset + overlap);
+      worker.Stats().Add(stats::Counter::BytesScanned, std::min(size_, next_offset) - offset);
+      if (ContainsNeedle({bytes + offset, end - offset}, needle)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  FsNode* fsNode_ = nullptr;
+  int fd_ = -1;
+  std::size_t size_ = 0;
+};
+
+} // namespace rbs
+
+#endif // RBS_SEARCH_FILE_JOB_HPP
@@ -0,0 +1,325 @@
+#ifndef RBS_JOBS_TRAVERSE_DIRECTORY_JOB_HPP
+#define RBS_JOBS_TRAVERSE_DIRECTORY_JOB_HPP
+
+#include <cerrno>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <system_error>
+#include <dirent.h>
+#include <cassert>
+#include "dir_cache.hpp"
+#include "fs_node.hpp"
+#include "jobs/search_file_job.hpp"
+#include "log.hpp"
+#include "result.hpp"
+#include "stats.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rbs {
+
+
+class TraverseDirectoryJob final {
+  static constexpr Logger kLogger{"TraverseDirectoryJob"};
+
+public:
+  explicit constexpr TraverseDirectoryJob(FsNode* dir, DIR* dirHandle) noexcept
+      : dir_(dir), dirHandle_(dirHandle) {}
+
+  template <class Worker>
+  constexpr void Service(Worker& worker) noexcept {
+    DirectoryCache* cache = worker.DirectoryCache();
+    const bool follow_symlinks = worker.FollowSymlinks();
+
+    struct stat dir_stat;
+    const bool have_stat =
+        (cache != nullptr || follow_symlinks) && fstat(dirfd(dirHandle_), &dir_stat) == 0;
+
+    // Following links, we may reach a directory more than once, or even one of its own ancestors.
+    // Whoever gets here first traverses it.
+    if (follow_symlinks && have_stat &&
+        !worker.Visited()->Insert(dir_stat.st_dev, dir_stat.st_ino)) {
+      closedir(dirHandle_);
+      return;
+    }
+
+    worker.Stats().Add(stats::Counter::DirectoriesRead);
+
+    // When caching, we either replay the listing we read last time, or start watching the
+    // directory before reading it, so that we can cache what we read.
+    DirectoryCache::Key key{};
+    int watch = -1;
+    if (cache != nullptr && have_stat) {
+      key = DirectoryCache::Key{dir_stat.st_dev, dir_stat.st_ino};
+      if (const DirectoryCache::Listing* listing = cache->Find(key)) {
+        serviceCached(worker, *listing);
+        matchNames(worker);
+        closedir(dirHandle_);
+        return;
+      }
+
+      watch = cache->Watch(dirfd(dirHandle_));
+    }
+
+    DirectoryCache::Listing listing;
+    bool complete = false;
+    while (true) {
+      // Note this implementation assumes that ServiceImpl is noexcept to close the fd at the end.
+      // TODO(marko): Improve the following. Note that there is an off-by-one error here. We create
+      // memory for the Directory object, but since readdir_r may fail, we never attempt to
+      // deallocate it. It would be good if we reused that memory.
+      FsNode* dir = worker.FsNodeArena()->UnfencedAlloc();
+      if (dir == nullptr) {
+        kLogger.Error("Failed to allocate memory for Directory object. This is a bug.");
+        std::terminate();
+      }
+      dir->Parent = dir_;
+
+      dirent* entry = nullptr;
+      if (readdir_r(dirHandle_, &dir->Entry, &entry) != 0) {
+        break;
+      }
+
+      if (entry == nullptr) [[unlikely]] {
+        complete = true;
+        break;
+      }
+
+      const std::string_view entry_name = EntryName(dir->Entry);
+      if (entry_name == "." || entry_name == "..") {
+        // Skip the current and parent directory entries
+        continue;
+      }
+
+      if (watch != -1) {
+        listing.Add(entry_name, dir->Entry.d_type);
+      }
+
+      visitEntry(worker, dir);
+    }
+
+    // A listing cut short by an error would hide the rest of the directory from later searches.
+    if (watch != -1 && (!complete || !cache->Insert(key, watch, std::move(listing)))) {
+      cache->Unwatch(watch);
+    }
+
+    matchNames(worker);
+    closedir(dirHandle_);
+  }
+
+  [[nodiscard]] static constexpr auto FromPath(
+    const std::filesystem::path& path
+  ) -> TraverseDirectoryJob {
+    DIR* dir_handle = opendir(path.c_str());
+    if (dir_handle == nullptr) {
+      throw std::system_error(errno, std::generic_category());
+    }
+
+    return TraverseDirectoryJob{nullptr, dir_handle};
+  }
+
+  [[nodiscard]] constexpr auto Exists() const noexcept -> bool {
+    return dirHandle_ != nullptr;
+  }
+
+private:
+  /// @brief Visits every entry of a listing read by an earlier search.
+  template <class Worker>
+  constexpr void serviceCached(Worker& worker, const DirectoryCache::Listing& listing) noexcept {
+    for (std::size_t i = 0; i < listing.Size(); ++i) {
+      FsNode* dir = worker.FsNodeArena()->UnfencedAlloc();
+      if (dir == nullptr) {
+        kLogger.Error("Failed to allocate memory for Directory object. This is a bug.");
+        std::terminate();
+      }
+      AssignEntry(*dir, listing.Name(i), listing.Type(i), dir_);
+      visitEntry(worker, dir);
+    }
+  }
+
+  /// @brief Submits a subdirectory for traversal, or a file for searching.
+  template <class Worker>
+  constexpr void visitEntry(Worker& worker, FsNode* dir) noexcept {
+    const std::string_view entry_name = EntryName(dir->Entry);
+    worker.Stats().Add(stats::Counter::EntriesSeen);
+
+    if (worker.MatchNames()) {
+      worker.Names().Add(dir, entry_name);
+      if (worker.Names().Full()) {
+        matchNames(worker);
+      }
+
+      // Only names are searched, so there is no need to open files.
+      if (dir->Entry.d_type == DT_REG) {
+        return;
+      }
+    }
+
+    switch (dir->Entry.d_type) {
+      case DT_DIR: {
+        // If the entry is a directory, we need to open it, and submit it open to the scheduler.
+        const int dir_fd =
+            openAt(worker, dirfd(dirHandle_), dir->Entry.d_name, O_RDONLY | O_DIRECTORY);
+        if (dir_fd == -1) [[unlikely]] {
+          // Failed to open directory, log the error.
+          kLogger.Error(std::format("Failed to open directory {}: {}",
+                                   entry_name, std::strerror(errno)));
+          return;
+        }
+        DIR* new_dir_handle = fdopendir(dir_fd);
+
+        worker.Submit(TraverseDirectoryJob(dir, new_dir_handle));
+        return;
+      }
+      case DT_LNK: {
+        if (worker.FollowSymlinks()) {
+          visitSymlink(worker, dir);
+        }
+        return;
+      }
+      case DT_REG: {
+        // We found a regular file that we can search in.
+        worker.OpenFile();
+        const int file_fd = openAt(worker, dirfd(dirHandle_), dir->Entry.d_name, O_RDONLY);
+        if (file_fd == -1) [[unlikely]] {
+          worker.FinishVisitingFile();
+          // Failed to open file, log the error.
+          kLogger.Error(std::format("Failed to open file {}: {}",
+                                   entry_name, std::strerror(errno)));
+          return;
+        }
+
+        worker.Stats().Add(stats::Counter::FilesOpened);
+
+        // We need the size anyway to map the file, and knowing it up front lets the scheduler
+        // get the largest files going first.
+        struct stat file_stat;
+        if (fstat(file_fd, &file_stat) == -1) [[unlikely]] {
+          kLogger.Error(std::format("Failed to get file status of {}: {}",
+                                   entry_name, std::strerror(errno)));
+          close(file_fd);
+          worker.FinishVisitingFile();
+          return;
+        }
+
+        submitFile(worker, dir, file_fd, file_stat);
+        return;
+      }
+      default: {
+        kLogger.Error(std::format("Unknown entry type encountered in directory traversal: {}",
+                                 dir->Entry.d_type));
+        return;
+      }
+    }
+  }
+
+  /// @brief Matches the names gathered so far, and queues up results for those which match.
+  template <class Worker>
+  constexpr void matchNames(Worker& worker) noexcept {
+    if (worker.MatchNames()) {
+      worker.Names().Match(worker.SearchString(),
+                           [&worker](FsNode* node) { worker.PushResult(Result{node}); });
+    }
+  }
+
+  /// @brief Follows a symbolic link to a directory or a regular file. Anything else it points to,
+  ///        and dangling links, are skipped.
+  template <class Worker>
+  constexpr void visitSymlink(Worker& worker, FsNode* dir) noexcept {
+    const std::string_view entry_name = EntryName(dir->Entry);
+
+    // We can't tell what the link points to without following it, so we count it as a file until
+    // we know better. O_NONBLOCK keeps us from hanging on a link to a FIFO. When only matching
+    // names, files are of no interest, and O_DIRECTORY keeps us from opening them at all.
+    worker.OpenFile();
+    const int link_fd =
+        openAt(worker, dirfd(dirHandle_), dir->Entry.d_name,
+               O_RDONLY | O_NONBLOCK | (worker.MatchNames() ? O_DIRECTORY : 0));
+    if (link_fd == -1) [[unlikely]] {
+      worker.FinishVisitingFile();
+      if (errno != ENOENT && errno != ELOOP && errno != ENOTDIR) {
+        kLogger.Error(std::format("Failed to follow link {}: {}", entry_name,
+                                  std::strerror(errno)));
+      }
+      return;
+    }
+
+    struct stat target_stat;
+    if (fstat(link_fd, &target_stat) == -1) [[unlikely]] {
+      kLogger.Error(std::format("Failed to get file status of {}: {}", entry_name,
+                                std::strerror(errno)));
+      close(link_fd);
+      worker.FinishVisitingFile();
+      return;
+    }
+
+    if (S_ISDIR(target_stat.st_mode)) {
+      // Submitting accounts for it as a directory. Whether we have been there before is checked
+      // once it's traversed, since that covers the root too.
+      worker.FinishVisitingFile();
+      worker.Submit(TraverseDirectoryJob(dir, fdopendir(link_fd)));
+      return;
+    }
+
+    if (!S_ISREG(target_stat.st_mode)) {
+      close(link_fd);
+      worker.FinishVisitingFile();
+      return;
+    }
+
+    worker.Stats().Add(stats::Counter::FilesOpened);
+    submitFile(worker, dir, link_fd, target_stat);
+  }
+
+  /// @brief Submits an open regular file for searching, unless there is nothing to search in it.
+  template <class Worker>
+  constexpr void submitFile(Worker& worker, FsNode* dir, int fileFd,
+                            const struct stat& fileStat) noexcept {
+    if (fileStat.st_size == 0) {
+      // Nothing to search in an empty file.
+      close(fileFd);
+      worker.FinishVisitingFile();
+      return;
+    }
+
+    // Without links to follow, a file with a single name can't be reached twice, so there is no
+    // need to remember it.
+    if (worker.DedupeFiles() && (worker.FollowSymlinks() || fileStat.st_nlink > 1) &&
+        !worker.Visited()->Insert(fileStat.st_dev, fileStat.st_ino)) {
+      close(fileFd);
+      worker.FinishVisitingFile();
+      return;
+    }
+
+    worker.Submit(SearchFileJob(dir, fileFd, static_cast<std::size_t>(fileStat.st_size)));
+  }
+
+  /// @brief openat(2), except that running out of descriptors is reported to the budget, and
+  ///        retried after searching files to free some up.
+  template <class Worker>
+  static auto openAt(Worker& worker, int dirFd, const char* name, int flags) noexcept -> int {
+    while (true) {
+      const int file_desc = openat(dirFd, name, flags);
+      if (file_desc != -1 || (errno != EMFILE && errno != ENFILE)) [[likely]] {
+        return file_desc;
+      }
+
+      const int open_errno = errno;
+      worker.ReportFdsExhausted();
+      if (!worker.TryFileReadingJob()) {
+        // Nothing we can close right now, so give up on this entry.
+        errno = open_errno;
+        return -1;
+      }
+    }
+  }
+
+  FsNode* dir_;
+  DIR* dirHandle_;
+};
+
+} // namespace rbs
+
+#endif // RBS_JOBS_TRAVERSE_DIRECTORY_JOB_HPP
@@ -0,0 +1,72 @@
+#ifndef RBS_NAME_BATCH_HPP
+#define RBS_NAME_BATCH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "fs_node.hpp"
+#include "search_kernel.hpp"
+
+namespace rbs {
+
+/// @brief Entry names gathered from a directory, laid out back to back so that the search kernel
+///        scans them all in one pass, rather than starting over for every short name.
+///
+/// Names are separated by '/', which no name can contain, so a match never spans two names.
+class NameBatch {
+ private:
+  static constexpr char kSeparator = '/';
+
+  /// @brief Once the names add up to this many bytes, the batch should be matched before adding
+  ///        more. Keeps huge directories from growing the buffer without bound.
+  static constexpr std::size_t kFullSize = 64ULL * 1024ULL;
+
+ public:
+  void Add(FsNode* node, std::string_view name) {
+    starts_.push_back(static_cast<std::uint32_t>(names_.size()));
+    nodes_.push_back(node);
+    names_.append(name);
+    names_.push_back(kSeparator);
+  }
+
+  [[nodiscard]] constexpr auto Full() const noexcept -> bool { return names_.size() >= kFullSize; }
+
+  /// @brief Calls onMatch with the node of every name which contains the needle, once each, and
+  ///        empties the batch.
+  template <class OnMatch>
+  void Match(std::string_view needle, OnMatch&& onMatch) {
+    // A name can't contain either of these, so nothing would match.
+    if (!needle.contains(kSeparator) && !needle.contains('\0')) {
+      const std::string_view names{names_};
+      std::size_t offset = 0;
+      while (offset < names.size()) {
+        const std::size_t found = FindNeedle(names.substr(offset), needle);
+        if (found == std::string_view::npos) {
+          break;
+        }
+
+        // Find the name the match is in, and carry on from the one after it.
+        const auto next = std::ranges::upper_bound(starts_, offset + found);
+        onMatch(nodes_[static_cast<std::size_t>(next - starts_.begin()) - 1]);
+        offset = next == starts_.end() ? names.size() : *next;
+      }
+    }
+
+    names_.clear();
+    starts_.clear();
+    nodes_.clear();
+  }
+
+ private:
+  std::string names_;
+  /// @brief Where each name starts in names_.
+  std::vector<std::uint32_t> starts_;
+  std::vector<FsNode*> nodes_;
+};
+
+}  // namespace rbs
+
+#endif  // RBS_NAME_BATCH_HPP
@@ -0,0 +1,151 @@
+#ifndef RBS_SEARCHER_HPP
+#define RBS_SEARCHER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "stats.hpp"
+
+namespace rbs {
+
+struct FsNode;
+
+/// @brief Tunables for a Searcher's worker pool, fixed for its lifetime.
+struct PoolOptions {
+  /// @brief Number of worker threads. Must be at least one, since only the workers can tell that
+  ///        a search is done.
+  std::uint16_t Threads =
+      static_cast<std::uint16_t>(std::max(std::thread::hardware_concurrency(), 1U));
+  /// @brief Raise the soft RLIMIT_NOFILE as far as the hard limit allows, up to what we can use.
+  bool RaiseFdLimit = true;
+  /// @brief Search the largest files first. When off, files are searched in the order they were
+  ///        found.
+  bool SizeAwareScheduling = true;
+  /// @brief Search the decompressed contents of gzip and zstd files, as far as this build can
+  ///        decompress them. Other files are searched as usual.
+  bool SearchCompressed = false;
+  /// @brief Follow symbolic links. Every directory is still only visited once, so links can't
+  ///        send us around in circles.
+  bool FollowSymlinks = false;
+  /// @brief Search every file once, even if it is reachable through several hard links, or
+  ///        symbolic links when following them.
+  bool DedupeFiles = false;
+  /// @brief Record per-worker statistics, see Searcher::WriteStats. Costs a little on every job.
+  bool CollectStats = false;
+  /// @brief Number of trace events each worker keeps. Tracing is off when this is zero.
+  std::size_t TraceCapacity = 0;
+  /// @brief Record only one in this many trace events.
+  std::uint32_t TraceSampleEvery = 1;
+  /// @brief Keep directory listings between searches, and only read directories again once they
+  ///        change. Only has an effect on Linux and macOS, where changes are watched for with
+  ///        inotify and kqueue.
+  bool CacheDirectories = false;
+  /// @brief The most directory listings to cache. Each holds a watch, so this is also lowered to
+  ///        half of the user's inotify watches on Linux, and a quarter of the descriptors on
+  ///        macOS.
+  std::size_t DirectoryCacheCapacity = 1ULL << 16ULL;
+};
+
+/// @brief A single search through the files under a directory.
+struct Query {
+  /// @brief The directory to search.
+  std::filesystem::path Root;
+  /// @brief The string to look for in each file's contents.
+  std::string_view Needle;
+  /// @brief Look for the needle in the names of files and directories instead, like
+  ///        `find -name '*NEEDLE*'`. No file is opened, and directories match too.
+  bool MatchNames = false;
+  /// @brief When not -1, a descriptor to read a list of files from, separated by NUL or newlines.
+  ///        Only those files are searched, with relative paths resolved against Root, and nothing
+  ///        is traversed. The descriptor is read to its end, but not closed.
+  int FilesFrom = -1;
+};
+
+/// @brief A file which contains the needle, or an entry whose name does.
+///
+/// @note A match is only valid for the duration of the callback it was handed to.
+class Match {
+ public:
+  explicit constexpr Match(const FsNode* fsNode) noexcept : fsNode_(fsNode) {}
+
+  /// @brief Returns the name of the file, without its directory.
+  [[nodiscard]] auto Name() const noexcept -> std::string_view;
+
+  /// @brief Builds the path of the file at the end of the buffer, followed by tailChar.
+  ///
+  /// @throws std::runtime_error if the path does not fit.
+  [[nodiscard]] auto Path(std::span<char> buf, char tailChar = '\0') const -> std::string_view;
+
+ private:
+  const FsNode* fsNode_;
+};
+
+/// @brief A pool of worker threads which runs searches, one at a time.
+///
+/// The threads, queues and descriptor budget are set up once and reused by every search, so
+/// running many small searches doesn't pay for spawning a process or its threads each time.
+///
+/// Search may be called from several threads at once, in which case the searches run one after
+/// another, in the order they were called.
+class Searcher {
+ public:
+  /// @throws std::invalid_argument if PoolOptions::Threads is zero.
+  explicit Searcher(PoolOptions options = {});
+  ~Searcher();
+
+  Searcher(const Searcher&) = delete;
+  Searcher(Searcher&&) = delete;
+  auto operator=(const Searcher&) -> Searcher& = delete;
+  auto operator=(Searcher&&) -> Searcher& = delete;
+
+  /// @brief Runs a search, calling onMatch with every match as soon as it is found.
+  ///
+  /// onMatch is called from the calling thread, never concurrently with itself. If it throws, the
+  /// remaining matches are dropped and the exception is rethrown once the workers are done.
+  ///
+  /// @throws std::system_error if the root cannot be opened, or the file list cannot be read.
+  /// @throws std::invalid_argument if both Query::MatchNames and Query::FilesFrom are set.
+  template <class Callback>
+    requires std::is_invocable_v<Callback&, const Match&>
+  void Search(const Query& query, Callback&& onMatch) {
+    search(
+        query,
+        [](void* context, const Match& match) {
+          (*static_cast<std::remove_reference_t<Callback>*>(context))(match);
+        },
+        const_cast<void*>(static_cast<const void*>(std::addressof(onMatch))));
+  }
+
+  /// @brief Writes the statistics gathered over every search so far.
+  ///
+  /// @throws std::logic_error if the pool was not created with PoolOptions::CollectStats.
+  void WriteStats(std::ostream& out, stats::Format format) const;
+
+  /// @brief Writes the trace events recorded over every search so far, in the Chrome trace event
+  ///        format.
+  void WriteTrace(std::ostream& out) const;
+
+  /// @brief Search's callback, with its type erased so that the pool can live out of line.
+  using MatchCallback = void (*)(void* context, const Match& match);
+
+  /// @brief The pool is picked at runtime based on PoolOptions::CollectStats, so it lives behind
+  ///        this interface.
+  class Impl;
+
+ private:
+  void search(const Query& query, MatchCallback onMatch, void* context);
+
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace rbs
+
+#endif  // RBS_SEARCHER_HPP
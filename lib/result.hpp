@@ -13,11 +13,13 @@ class Result {
  public:
   explicit Result(const FsNode* fsNode) : fsNode_(fsNode) {}
 
-  [[nodiscard]] constexpr auto Name() -> std::string_view {
-    return {fsNode_->Entry.d_name, fsNode_->Entry.d_namlen};
+  [[nodiscard]] constexpr auto Node() const noexcept -> const FsNode* { return fsNode_; }
+
+  [[nodiscard]] constexpr auto Name() const -> std::string_view {
+    return EntryName(fsNode_->Entry);
   }
 
-  [[nodiscard]] constexpr auto ComputePathStr(std::span<char> buf, char tailChar)
+  [[nodiscard]] constexpr auto ComputePathStr(std::span<char> buf, char tailChar) const
       -> std::string_view {
     // We need the size assertion here since we will unconditionally write to the buffer in some
     // cases.
@@ -42,7 +44,7 @@ class Result {
     length += 1;
 
     while (current != nullptr) {
-      const std::string_view current_name{current->Entry.d_name, current->Entry.d_namlen};
+      const std::string_view current_name = EntryName(current->Entry);
 
       // The +1 is for the separator addition.
       if (length + current_name.size() + 1 > buffer_length) [[unlikely]] {
@@ -0,0 +1,712 @@
+#ifndef RBS_SCHED_HPP
+#define RBS_SCHED_HPP
+
+#include <pthread.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "alloc/arena.hpp"
+#include "concurrentqueue.h"
+#include "dir_cache.hpp"
+#include "fd_budget.hpp"
+#include "fs_node.hpp"
+#include "jobs/search_file_job.hpp"
+#include "jobs/traverse_directory_job.hpp"
+#include "result.hpp"
+#include "size_class_queue.hpp"
+#include "stats.hpp"
+#include "sync/balance.hpp"
+#include "sync/cpu_relax.hpp"
+#include "sync/visited_set.hpp"
+#include "trace.hpp"
+#include "worker.hpp"
+
+namespace rbs {
+
+template <class WorkerType>
+constexpr auto workerThreadEntry(void* arg) -> void*;
+
+/// @brief Tunables which are fixed for the lifetime of a Scheduler.
+struct SchedulerOptions {
+  /// @brief Raise the soft RLIMIT_NOFILE as far as the hard limit allows, up to what we can use.
+  bool RaiseFdLimit = true;
+  /// @brief Search the largest files first. When off, files are searched in the order they were
+  ///        found.
+  bool SizeAwareScheduling = true;
+  /// @brief Number of trace events each worker keeps. Tracing is off when this is zero.
+  std::size_t TraceCapacity = 0;
+  /// @brief Record only one in this many trace events.
+  std::uint32_t TraceSampleEvery = 1;
+  /// @brief Where to cache directory listings across searches, or nullptr to always read
+  ///        directories. The caller refreshes it between searches.
+  rbs::DirectoryCache* DirectoryCache = nullptr;
+  /// @brief Search the decompressed contents of gzip and zstd files.
+  bool SearchCompressed = false;
+  /// @brief Follow symbolic links, visiting every directory once.
+  bool FollowSymlinks = false;
+  /// @brief Search every file once, even if it is reachable through several links.
+  bool DedupeFiles = false;
+};
+
+template <class Allocator = std::allocator<std::byte>, class StatsPolicy = stats::Disabled>
+class Scheduler {
+ private:
+  static constexpr Logger kLogger{"Scheduler"};
+
+  /// @brief Number of directories and files the visited set holds before it gets slower.
+  static constexpr std::size_t kVisitedCapacity = 1ULL << 18ULL;
+
+  using WorkerType = Worker<Scheduler<Allocator, StatsPolicy>, StatsPolicy>;
+  friend WorkerType;
+
+ public:
+  constexpr Scheduler(Allocator allocator, std::uint16_t threadCount,
+                      SchedulerOptions options = {}) noexcept
+      : allocator_(std::move(allocator)),
+        threadCount_(threadCount),
+        options_(options),
+        fdBudget_(rbs::FdBudget::FromRlimit(options_.RaiseFdLimit)),
+        // The extra shard at the end belongs to whoever submits work from outside of the pool.
+        shards_(std::make_unique<WorkerShard[]>(threadCount_ + 1)),
+        visited_(options_.FollowSymlinks || options_.DedupeFiles
+                     ? std::make_unique<sync::VisitedSet>(kVisitedCapacity)
+                     : nullptr),
+        parked_(threadCount_) {
+    assert(threadCount_ > 0 && "Without workers, no search would ever complete.");
+    workers_.reserve(threadCount_);
+  }
+
+  explicit constexpr Scheduler(std::uint16_t threadCount, SchedulerOptions options = {}) noexcept
+      : Scheduler(Allocator{}, threadCount, options) {}
+
+  constexpr Scheduler(const Scheduler&) = delete;
+  constexpr Scheduler(Scheduler&&) = delete;
+  constexpr auto operator=(const Scheduler&) -> Scheduler& = delete;
+  constexpr auto operator=(Scheduler&&) -> Scheduler& = delete;
+
+  constexpr ~Scheduler() {
+    StopAll();
+
+    for (auto* worker : workerObjects_) {
+      delete worker;
+    }
+  }
+
+  constexpr void WaitForAll() noexcept {
+    for (auto& worker : workers_) {
+      const int err = pthread_join(worker, nullptr);
+      if (err != 0) [[unlikely]] {
+        std::cerr << "Failed to join worker thread: " << std::strerror(err) << '\n';
+        std::terminate();
+      }
+    }
+
+    // Joining a thread twice is undefined, and the destructor will call us again.
+    workers_.clear();
+  }
+
+  /// @brief Asks the workers to exit, abandoning any search in progress, and joins them.
+  constexpr void StopAll() {
+    exit_signal_.store(true, std::memory_order_relaxed);
+    // Parked workers only look at the exit signal once they are woken up.
+    generation_.fetch_add(1, std::memory_order_release);
+    generation_.notify_all();
+    wakeIdleWorkers();
+    WaitForAll();
+  }
+
+  constexpr void Run() {
+    workerObjects_.reserve(threadCount_);
+    workers_.reserve(threadCount_);
+
+    if (options_.TraceCapacity > 0) {
+      const auto epoch = std::chrono::steady_clock::now();
+      traceBuffers_.reserve(threadCount_);
+      for (std::uint16_t i = 0; i < threadCount_; ++i) {
+        traceBuffers_.push_back(std::make_unique<trace::RingBuffer>(
+            options_.TraceCapacity, options_.TraceSampleEvery, epoch));
+      }
+    }
+
+    for (std::uint16_t i = 0; i < threadCount_; ++i) {
+      auto* worker = new WorkerType(this, moodycamel::ProducerToken(traverseDirectoryQueue_),
+                                    moodycamel::ConsumerToken(traverseDirectoryQueue_),
+                                    searchFileQueue_.MakeProducerTokens(),
+                                    searchFileQueue_.MakeConsumerTokens(),
+                                    moodycamel::ProducerToken(resultQueue_), &fsNodeArena_,
+                                    &shards_[i],
+                                    traceBuffers_.empty() ? nullptr : traceBuffers_[i].get());
+
+      workerObjects_.emplace(workerObjects_.begin() + i, worker);
+      workers_.emplace(workers_.begin() + i, pthread_t{});
+      const int error_num = pthread_create(&workers_[i], nullptr, &workerThreadEntry<WorkerType>,
+                                           static_cast<void*>(workerObjects_[i]));
+
+      if (error_num != 0) [[unlikely]] {
+        std::cerr << "Failed to create worker thread: " << std::strerror(errno) << '\n';
+        std::terminate();
+      }
+    }
+  }
+
+  /// @brief Starts a new search through the pool's workers, which must all be parked.
+  ///
+  /// The search cannot complete before FinishSubmitting is called, so that jobs may be submitted
+  /// with SlowSubmit while the workers are already running.
+  ///
+  /// @param matchNames Look for the search string in the names of entries, rather than in files.
+  ///
+  /// @note Everything handed out by the previous search, including its results, is freed.
+  constexpr void Start(std::string_view searchString, bool matchNames = false) {
+    assert(IsIdle() && "A search may only be started once the previous one has finished.");
+
+    fsNodeArena_.Reset();
+    if (visited_ != nullptr) {
+      visited_->Clear();
+    }
+    searchString_ = searchString;
+    matchNames_ = matchNames;
+    completionPromise_ = std::promise<void>{};
+    completion_ = completionPromise_.get_future().share();
+    done_.store(false, std::memory_order_relaxed);
+    parked_.store(0, std::memory_order_relaxed);
+
+    // This stands in for the jobs we are yet to submit, and keeps the jobs from balancing out
+    // before we are done.
+    externalShard().Jobs.SharedOpen();
+    submitting_.store(true, std::memory_order_relaxed);
+
+    generation_.fetch_add(1, std::memory_order_release);
+    generation_.notify_all();
+  }
+
+  /// @brief Tells the workers that no more jobs will be submitted from outside of the pool.
+  constexpr void FinishSubmitting() noexcept {
+    submitting_.store(false, std::memory_order_relaxed);
+    externalShard().Jobs.SharedClose();
+    // Whoever is asleep has to find out whether that was the last job.
+    wakeIdleWorkers();
+  }
+
+  /// @brief Blocks until every worker has finished the current search and parked.
+  constexpr void WaitIdle() const noexcept {
+    std::uint16_t parked = parked_.load(std::memory_order_acquire);
+    while (parked != threadCount_) {
+      parked_.wait(parked, std::memory_order_acquire);
+      parked = parked_.load(std::memory_order_acquire);
+    }
+  }
+
+  /// @brief Returns whether every worker is parked, waiting for the next search.
+  [[nodiscard]] constexpr auto IsIdle() const noexcept -> bool {
+    return parked_.load(std::memory_order_acquire) == threadCount_;
+  }
+
+  /// @brief Returns whether the workers still have jobs left to do.
+  [[nodiscard]] constexpr auto IsBusy() const noexcept -> bool {
+    return !done_.load(std::memory_order_acquire);
+  }
+
+  /// @brief Returns a future which becomes ready once every submitted job has been serviced.
+  ///
+  /// Results may still be waiting in the result queue when the future becomes ready.
+  [[nodiscard]] auto Completion() const noexcept -> std::shared_future<void> { return completion_; }
+
+  constexpr void Submit(TraverseDirectoryJob&& job, moodycamel::ProducerToken& token,
+                        WorkerShard& shard) {
+    shard.Jobs.Open();
+    shard.Directories.Open();
+    const bool enqueue_result = traverseDirectoryQueue_.enqueue(token, job);
+    assert(enqueue_result && "Failed to enqueue job. This is a bug.");
+  }
+
+  constexpr void SlowSubmit(TraverseDirectoryJob&& job) {
+    externalShard().Jobs.SharedOpen();
+    externalShard().Directories.SharedOpen();
+    const bool enqueue_result = traverseDirectoryQueue_.enqueue(job);
+    assert(enqueue_result && "Failed to enqueue job. This is a bug.");
+    wakeIdleWorkers();
+  }
+
+  /// @brief Submits search jobs for files opened outside of the pool, in one go.
+  ///
+  /// The files must have been accounted for with SlowOpenFile. Only one thread may call this at a
+  /// time, since it shares one set of producer tokens.
+  constexpr void SlowSubmit(std::span<SearchFileJob> jobs) {
+    externalShard().Jobs.SharedOpen(jobs.size());
+
+    if (!options_.SizeAwareScheduling) {
+      const bool enqueue_result =
+          searchFileQueue_.EnqueueBulk(externalFileTokens_, 0, jobs.begin(), jobs.size());
+      assert(enqueue_result && "Failed to enqueue jobs. This is a bug.");
+      wakeIdleWorkers();
+      return;
+    }
+
+    // Each bulk enqueue goes to a single class, so we line the jobs up by class first.
+    std::ranges::sort(jobs, {}, &SearchFileJob::SizeClass);
+    for (auto run_begin = jobs.begin(); run_begin != jobs.end();) {
+      const std::size_t size_class = run_begin->SizeClass();
+      const auto run_end = std::ranges::find_if(
+          run_begin, jobs.end(), [size_class](const SearchFileJob& job) {
+            return job.SizeClass() != size_class;
+          });
+      const bool enqueue_result = searchFileQueue_.EnqueueBulk(
+          externalFileTokens_, size_class, run_begin,
+          static_cast<std::size_t>(run_end - run_begin));
+      assert(enqueue_result && "Failed to enqueue jobs. This is a bug.");
+      run_begin = run_end;
+    }
+    wakeIdleWorkers();
+  }
+
+  /// @brief Accounts for a file opened outside of the pool, see SlowSubmit.
+  constexpr void SlowOpenFile() noexcept { externalShard().Files.SharedOpen(); }
+
+  /// @brief Accounts for a file opened with SlowOpenFile which won't be submitted after all.
+  constexpr void SlowFinishVisitingFile() noexcept { externalShard().Files.SharedClose(); }
+
+  /// @brief Records that an open failed because we ran out of descriptors.
+  constexpr void ReportFdsExhausted() noexcept { fdBudget_.ReportExhausted(); }
+
+  /// @brief Where nodes for entries found outside of the pool are allocated. Like everything the
+  ///        workers allocate, they live until the next search starts.
+  [[nodiscard]] constexpr auto FsNodeArena() noexcept -> alloc::MPArena<FsNode>* {
+    return &fsNodeArena_;
+  }
+
+  constexpr void Submit(SearchFileJob&& job, SearchFileQueue::ProducerTokens& tokens,
+                        WorkerShard& shard) {
+    shard.Jobs.Open();
+    enqueueFile(std::move(job), tokens);
+  }
+
+  /// @brief Returns an estimate of the number of descriptors currently held by queued jobs.
+  [[nodiscard]] constexpr auto FdsCurrentlyOpen() const noexcept -> std::uint64_t {
+    const std::int64_t open = sync::Outstanding(shards(), &WorkerShard::Files) +
+                              sync::Outstanding(shards(), &WorkerShard::Directories);
+    return open < 0 ? 0 : static_cast<std::uint64_t>(open);
+  }
+
+  [[nodiscard]] constexpr auto FdBudget() const noexcept -> const rbs::FdBudget& {
+    return fdBudget_;
+  }
+
+  /// @brief Feeds the current descriptor count and queue depths to the descriptor budget.
+  constexpr void AdjustFdBudget(std::uint64_t fdsOpen) noexcept {
+    fdBudget_.Adjust(fdsOpen, searchFileQueue_.SizeApprox(), traverseDirectoryQueue_.size_approx(),
+                     threadCount_);
+  }
+
+  /// @brief Checks whether all work is done and, if so, signals completion.
+  ///
+  /// This reads every worker's shard, so workers only call it when they are out of jobs.
+  constexpr auto TryComplete() noexcept -> bool {
+    if (done_.load(std::memory_order_acquire)) {
+      return true;
+    }
+
+    if (!sync::IsQuiescent(shards(), &WorkerShard::Jobs)) {
+      return false;
+    }
+
+    bool expected = false;
+    if (done_.compare_exchange_strong(expected, true, std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+      completionPromise_.set_value();
+    }
+    return true;
+  }
+
+  /// @brief Collects every worker's statistics, along with the state of the descriptor budget.
+  ///
+  /// @note The workers must be parked, see WaitIdle.
+  [[nodiscard]] auto CollectStats(std::chrono::nanoseconds wallTime) const -> stats::Snapshot
+    requires StatsPolicy::kEnabled
+  {
+    assert(IsIdle() && "Statistics may only be collected while the workers are parked.");
+
+    stats::Snapshot snapshot{
+        .Workers = {},
+        .WallTime = wallTime,
+        .FdSoftLimit = fdBudget_.SoftLimit(),
+        .FdHardLimit = fdBudget_.HardLimit(),
+        .FdLimitRaised = fdBudget_.Raised(),
+        .FdCeiling = fdBudget_.Ceiling(),
+        .FdTarget = fdBudget_.Target(),
+        .FdAdjustments = fdBudget_.Adjustments(),
+        .FdExhausted = fdBudget_.ExhaustedEvents(),
+    };
+
+    snapshot.Workers.reserve(workerObjects_.size());
+    for (const WorkerType* worker : workerObjects_) {
+      snapshot.Workers.push_back(worker->Stats());
+    }
+    return snapshot;
+  }
+
+  /// @brief Writes every worker's trace events in the Chrome trace event format.
+  ///
+  /// @note The workers must be parked, see WaitIdle.
+  void WriteTrace(std::ostream& out) const {
+    assert(IsIdle() && "Traces may only be written while the workers are parked.");
+    trace::WriteChromeTrace(out, traceBuffers_);
+  }
+
+  [[nodiscard]] constexpr auto ResultToken() noexcept -> moodycamel::ConsumerToken {
+    return moodycamel::ConsumerToken(resultQueue_);
+  }
+
+  /// @todo(marko): Don't use std::optional
+  [[nodiscard]] constexpr auto GetResult(moodycamel::ConsumerToken& token) noexcept
+      -> std::optional<Result> {
+    Result result{nullptr};
+    if (!resultQueue_.try_dequeue(token, result)) {
+      return std::nullopt;
+    }
+
+    return {result};
+  }
+
+ private:
+  [[nodiscard]] constexpr auto shards() const noexcept -> std::span<const WorkerShard> {
+    return {shards_.get(), static_cast<std::size_t>(threadCount_) + 1};
+  }
+
+  /// @brief Queues up a search job which has already been accounted for.
+  constexpr void enqueueFile(SearchFileJob&& job, SearchFileQueue::ProducerTokens& tokens) {
+    // Without size awareness, everything goes into the first class, which is plain FIFO.
+    const std::size_t size_class = options_.SizeAwareScheduling ? job.SizeClass() : 0;
+    const bool enqueue_result = searchFileQueue_.Enqueue(tokens, size_class, std::move(job));
+    assert(enqueue_result && "Failed to enqueue job. This is a bug.");
+  }
+
+  [[nodiscard]] constexpr auto externalShard() noexcept -> WorkerShard& {
+    return shards_[threadCount_];
+  }
+
+  /// @brief Puts an idle worker to sleep until jobs are submitted from outside of the pool, or no
+  ///        more will be.
+  ///
+  /// Only worth it while the submitter is still going. It may be blocked on reading a file list
+  /// for a long time, and spinning all the while would take the CPU from whoever produces the
+  /// list. Once it's done, the workers only wait on each other, which never takes long.
+  constexpr void parkIdleWorker() noexcept {
+    const std::uint32_t seen = submissions_.load(std::memory_order_seq_cst);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    // Any submission from here on either changes what we wait on, or sees us asleep and wakes us.
+    if (submitting_.load(std::memory_order_seq_cst)) {
+      submissions_.wait(seen, std::memory_order_seq_cst);
+    }
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  constexpr void wakeIdleWorkers() noexcept {
+    submissions_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+      submissions_.notify_all();
+    }
+  }
+
+  alloc::MPArena<FsNode> fsNodeArena_;
+
+  Allocator allocator_;
+
+  std::uint16_t threadCount_;
+  SchedulerOptions options_;
+  rbs::FdBudget fdBudget_;
+  // TODO(marko): Share allocator with this vector.
+  std::vector<pthread_t> workers_;
+
+  std::vector<WorkerType*> workerObjects_;
+
+  std::unique_ptr<WorkerShard[]> shards_;
+
+  /// @brief Directories and files visited by the current search, when we need to know.
+  std::unique_ptr<sync::VisitedSet> visited_;
+
+  std::vector<std::unique_ptr<trace::RingBuffer>> traceBuffers_;
+
+  moodycamel::ConcurrentQueue<TraverseDirectoryJob> traverseDirectoryQueue_;
+  SearchFileQueue searchFileQueue_;
+  /// @brief Used by SlowSubmit, from whichever thread is running the search.
+  SearchFileQueue::ProducerTokens externalFileTokens_{searchFileQueue_.MakeProducerTokens()};
+
+  moodycamel::ConcurrentQueue<Result> resultQueue_;
+
+  std::string_view searchString_;
+  /// @brief Whether the current search looks at entry names rather than file contents.
+  bool matchNames_ = false;
+
+  std::atomic<bool> exit_signal_ alignas(std::hardware_destructive_interference_size){false};
+
+  std::atomic<bool> done_ alignas(std::hardware_destructive_interference_size){false};
+
+  /// @brief Whether jobs may still be submitted from outside of the pool, see FinishSubmitting.
+  std::atomic<bool> submitting_ alignas(std::hardware_destructive_interference_size){false};
+  /// @brief Bumped for every submission from outside of the pool, to wake up idle workers.
+  std::atomic<std::uint32_t> submissions_{0};
+  /// @brief Number of idle workers asleep in parkIdleWorker.
+  std::atomic<std::uint16_t> sleepers_{0};
+
+  /// @brief Bumped for every search, and on exit, to wake up parked workers.
+  std::atomic<std::uint64_t> generation_ alignas(std::hardware_destructive_interference_size){0};
+  /// @brief Number of workers waiting for the next search.
+  std::atomic<std::uint16_t> parked_;
+
+  std::promise<void> completionPromise_;
+  std::shared_future<void> completion_;
+};
+
+template <class Scheduler, class StatsPolicy>
+constexpr auto Worker<Scheduler, StatsPolicy>::TryFileReadingJob() noexcept -> bool {
+  // Keep a few jobs queued up locally, with the kernel already reading the larger ones in, so that
+  // their I/O overlaps with searching the job at the front. Once fewer jobs are left than there are
+  // workers, we only take the one we search, and leave the rest to whoever is idle.
+  const std::size_t depth =
+      scheduler_->searchFileQueue_.SizeApprox() > scheduler_->threadCount_ ? kReadaheadDepth : 1;
+  while (readaheadCount_ < depth) {
+    SearchFileJob next = GetSearchFileJob();
+    if (!next.Exists()) {
+      break;
+    }
+
+    // A file which fits into our buffer is read with a single pread, which costs no more than
+    // the advice would.
+    if (next.Size() > kReadBufferSize) {
+      next.Prefetch();
+    }
+    readahead_[(readaheadHead_ + readaheadCount_) % kReadaheadDepth] = next;
+    ++readaheadCount_;
+  }
+
+  if (readaheadCount_ == 0) {
+    return false;
+  }
+
+  SearchFileJob job = readahead_[readaheadHead_];
+  readaheadHead_ = (readaheadHead_ + 1) % kReadaheadDepth;
+  --readaheadCount_;
+
+  // Once nothing is left to traverse and the queue has run dry, whatever we hold is the tail of
+  // the search. Let idle workers have it, rather than leave it waiting behind this job.
+  if (scheduler_->searchFileQueue_.SizeApprox() == 0 &&
+      scheduler_->traverseDirectoryQueue_.size_approx() == 0) {
+    returnHeldJobs();
+  }
+
+  {
+    const typename StatsPolicy::ScopedTimer timer{stats_, stats::Timer::SearchFile};
+    const trace::ScopedSpan span{trace_, trace::Event::SearchFile, job.Size()};
+    job.Service(*this);
+  }
+  shard_->Jobs.Close();
+  return true;
+}
+
+template <class Scheduler, class StatsPolicy>
+constexpr auto Worker<Scheduler, StatsPolicy>::TryDirectoryTraversalJob() noexcept -> bool {
+  TraverseDirectoryJob job = GetTraverseDirectoryJob();
+  if (!job.Exists()) {
+    return false;
+  }
+
+  {
+    const typename StatsPolicy::ScopedTimer timer{stats_, stats::Timer::TraverseDirectory};
+    const trace::ScopedSpan span{trace_, trace::Event::TraverseDirectory};
+    job.Service(*this);
+  }
+  shard_->Directories.Close();
+  shard_->Jobs.Close();
+  return true;
+}
+
+template <class Scheduler, class StatsPolicy>
+constexpr auto Worker<Scheduler, StatsPolicy>::TryDoJob() noexcept -> bool {
+  if (++jobsSinceRefresh_ >= kFdsOpenRefreshInterval) {
+    jobsSinceRefresh_ = 0;
+    fdsOpenEstimate_ = scheduler_->FdsCurrentlyOpen();
+    scheduler_->AdjustFdBudget(fdsOpenEstimate_);
+  }
+
+  if (FdsOpen() > scheduler_->FdBudget().Target()) {
+    // We have too many file descriptors open, let's service searching through files, rather than
+    // open more files.
+    if (!TryFileReadingJob()) {
+      // There doesn't appear to be a job we can do right now. Everything we have open is waiting
+      // to be traversed, and traversing a directory is the only way to give its descriptor back,
+      // so we do that. Any open that runs into the limit is retried after searching, and shrinks
+      // the budget.
+      //
+      // It's worse to be sitting idle.
+      return TryDirectoryTraversalJob();
+    }
+
+    // We managed to read the file just fine.
+    return true;
+  }
+
+  // In the other case, we should go ahead and open some files.
+  if (!TryDirectoryTraversalJob()) {
+    // There were no jobs to traverse directories, let's avoid sitting idle.
+    return TryFileReadingJob();
+  }
+
+  return true;
+}
+
+template <class Scheduler, class StatsPolicy>
+constexpr void Worker<Scheduler, StatsPolicy>::runSearch() {
+  static constexpr std::uint32_t kSpinnerBackoff = 1;
+  // How long we spin, as the number of rounds, before we consider going to sleep.
+  static constexpr std::uint32_t kSpinsBeforeParking = 64;
+  std::uint32_t spin_count = 0;
+
+  // When tracing, the time at which we last ran out of jobs.
+  std::optional<std::uint64_t> idle_since;
+  const auto finish_idle = [&]() noexcept {
+    if (idle_since.has_value() && trace_->Sample()) {
+      trace_->Push(trace::Record{*idle_since, trace_->Now() - *idle_since, 0, trace::Event::Idle});
+    }
+    idle_since.reset();
+  };
+
+  while (true) {
+    if (scheduler_->exit_signal_.load(std::memory_order_relaxed)) {
+      // The user requested exit. Abort everything and get out. Don't even flush.
+      break;
+    }
+
+    if (TryDoJob()) {
+      spin_count = 0;
+      finish_idle();
+      continue;
+    }
+
+    // We couldn't find anything to do. Either other workers are still producing jobs, or everything
+    // is done. Only now is it worth scanning everyone's shards to find out which.
+    if (scheduler_->TryComplete()) {
+      // The wait for the last jobs to finish is the imbalance the trace is there to show.
+      finish_idle();
+      break;
+    }
+
+    if (trace_ != nullptr && !idle_since.has_value()) {
+      idle_since = trace_->Now();
+    }
+
+    if (spin_count >= kSpinsBeforeParking &&
+        scheduler_->submitting_.load(std::memory_order_relaxed)) {
+      // Nothing else will turn up until the submitter gets around to it, so there is no point
+      // in burning a core while we wait.
+      stats_.Add(stats::Counter::Parks);
+      scheduler_->parkIdleWorker();
+      spin_count = 0;
+      continue;
+    }
+
+    spin_count += kSpinnerBackoff;
+    stats_.Add(stats::Counter::SpinIterations, spin_count);
+    // Spin a tiny bit to back-off from the queues.
+    for (std::size_t i = 0; i < spin_count; ++i) {
+      sync::CpuRelax();
+    }
+  }
+}
+
+template <class Scheduler, class StatsPolicy>
+constexpr void Worker<Scheduler, StatsPolicy>::Run() {
+  // The pool outlives any one search. Between searches, we sleep until the scheduler starts the
+  // next one.
+  std::uint64_t generation = 0;
+  while (true) {
+    scheduler_->generation_.wait(generation, std::memory_order_acquire);
+    generation = scheduler_->generation_.load(std::memory_order_acquire);
+
+    if (scheduler_->exit_signal_.load(std::memory_order_relaxed)) {
+      break;
+    }
+
+    runSearch();
+
+    scheduler_->parked_.fetch_add(1, std::memory_order_release);
+    scheduler_->parked_.notify_all();
+  }
+}
+
+template <class Scheduler, class StatsPolicy>
+constexpr auto Worker<Scheduler, StatsPolicy>::GetTraverseDirectoryJob() noexcept
+    -> TraverseDirectoryJob {
+  TraverseDirectoryJob job{nullptr, nullptr};
+  if (!scheduler_->traverseDirectoryQueue_.try_dequeue(directoryConsumerToken_, job)) {
+    stats_.Add(stats::Counter::DequeueMisses);
+  }
+  return job;
+}
+
+template <class Scheduler, class StatsPolicy>
+constexpr auto Worker<Scheduler, StatsPolicy>::GetSearchFileJob() noexcept -> SearchFileJob {
+  if (smallFileBatchHead_ < smallFileBatchSize_) {
+    return smallFileBatch_[smallFileBatchHead_++];
+  }
+
+  SearchFileQueue& queue = scheduler_->searchFileQueue_;
+
+  // Take the largest files first. A large file picked up late would otherwise be the one straggler
+  // that everyone waits on at the end.
+  SearchFileJob job;
+  for (std::size_t size_class = 0; size_class < SearchFileQueue::kClasses - 1; ++size_class) {
+    if (queue.TryDequeue(fileSearchConsumerTokens_, size_class, job)) {
+      return job;
+    }
+  }
+
+  // Take no more than our share of what is left, so that the last small files are spread over
+  // every worker rather than sitting in one worker's batch.
+  const std::size_t share = queue.SizeApprox() / scheduler_->threadCount_;
+  smallFileBatchHead_ = 0;
+  smallFileBatchSize_ =
+      queue.TryDequeueBulk(fileSearchConsumerTokens_, SearchFileQueue::kClasses - 1,
+                           smallFileBatch_.begin(),
+                           std::clamp<std::size_t>(share, 1, smallFileBatch_.size()));
+  if (smallFileBatchSize_ == 0) {
+    stats_.Add(stats::Counter::DequeueMisses);
+    return job;
+  }
+
+  return smallFileBatch_[smallFileBatchHead_++];
+}
+
+template <class Scheduler, class StatsPolicy>
+constexpr void Worker<Scheduler, StatsPolicy>::returnHeldJobs() noexcept {
+  // These are still accounted for as open jobs, so they go straight back into the queue.
+  for (; readaheadCount_ > 0; --readaheadCount_) {
+    scheduler_->enqueueFile(std::move(readahead_[readaheadHead_]), fileSearchProducerTokens_);
+    readaheadHead_ = (readaheadHead_ + 1) % kReadaheadDepth;
+  }
+
+  for (; smallFileBatchHead_ < smallFileBatchSize_; ++smallFileBatchHead_) {
+    scheduler_->enqueueFile(std::move(smallFileBatch_[smallFileBatchHead_]),
+                            fileSearchProducerTokens_);
+  }
+}
+
+template <class WorkerType>
+constexpr auto workerThreadEntry(void* arg) -> void* {
+  auto* worker = static_cast<WorkerType*>(arg);
+  worker->Run();
+  return nullptr;
+}
+
+}  // namespace rbs
+
+#endif  // RBS_SCHED_HPP
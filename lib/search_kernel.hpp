@@ -0,0 +1,30 @@
+#ifndef RBS_SEARCH_KERNEL_HPP
+#define RBS_SEARCH_KERNEL_HPP
+
+#include <cstddef>
+#include <string_view>
+#include "stringzilla/stringzilla.hpp"
+
+namespace rbs {
+
+/// @brief Returns the offset of the first occurrence of @p needle in @p haystack, or npos.
+[[nodiscard]] inline auto FindNeedle(std::string_view haystack,
+                                     std::string_view needle) noexcept -> std::size_t {
+  namespace sz = ashvardanian::stringzilla;
+  const std::size_t found = sz::string_view(haystack.data(), haystack.size())
+                                .find(sz::string_view(needle.data(), needle.size()));
+  return found == sz::string_view::npos ? std::string_view::npos : found;
+}
+
+/// @brief Returns whether @p needle occurs anywhere in @p haystack.
+///
+/// This is the innermost loop of every search, so it is kept in one place where it can be
+/// benchmarked on its own.
+[[nodiscard]] inline auto ContainsNeedle(std::string_view haystack,
+                                         std::string_view needle) noexcept -> bool {
+  return FindNeedle(haystack, needle) != std::string_view::npos;
+}
+
+}  // namespace rbs
+
+#endif  // RBS_SEARCH_KERNEL_HPP
@@ -0,0 +1,250 @@
+#include "rbs/searcher.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "concurrentqueue.h"
+#include "dir_cache.hpp"
+#include "file_list.hpp"
+#include "jobs/traverse_directory_job.hpp"
+#include "result.hpp"
+#include "sched.hpp"
+#include "sync/ticket_lock.hpp"
+
+namespace rbs {
+
+auto Match::Name() const noexcept -> std::string_view { return Result{fsNode_}.Name(); }
+
+auto Match::Path(std::span<char> buf, char tailChar) const -> std::string_view {
+  return Result{fsNode_}.ComputePathStr(buf, tailChar);
+}
+
+class Searcher::Impl {
+ public:
+  Impl() = default;
+  Impl(const Impl&) = delete;
+  Impl(Impl&&) = delete;
+  auto operator=(const Impl&) -> Impl& = delete;
+  auto operator=(Impl&&) -> Impl& = delete;
+  virtual ~Impl() = default;
+
+  virtual void Search(const Query& query, MatchCallback onMatch, void* context) = 0;
+  virtual void WriteStats(std::ostream& out, stats::Format format) const = 0;
+  virtual void WriteTrace(std::ostream& out) const = 0;
+};
+
+namespace {
+
+template <class StatsPolicy>
+class PoolImpl final : public Searcher::Impl {
+ private:
+  static constexpr auto kResultPollInterval = std::chrono::microseconds(50);
+
+  /// @brief How many listed paths we read before opening them. Bigger batches open directories
+  ///        fewer times when the list isn't sorted.
+  static constexpr std::size_t kFileListBatchSize = 1024;
+
+ public:
+  explicit PoolImpl(const PoolOptions& options)
+      : directoryCache_(options.CacheDirectories
+                            ? std::make_unique<DirectoryCache>(options.DirectoryCacheCapacity)
+                            : nullptr),
+        scheduler_(options.Threads,
+                   SchedulerOptions{
+                       .RaiseFdLimit = options.RaiseFdLimit,
+                       .SizeAwareScheduling = options.SizeAwareScheduling,
+                       .TraceCapacity = options.TraceCapacity,
+                       .TraceSampleEvery = options.TraceSampleEvery,
+                       .DirectoryCache = directoryCache_.get(),
+                       .SearchCompressed = options.SearchCompressed,
+                       .FollowSymlinks = options.FollowSymlinks,
+                       .DedupeFiles = options.DedupeFiles,
+                   }) {
+    scheduler_.Run();
+  }
+
+  void Search(const Query& query, Searcher::MatchCallback onMatch, void* context) override {
+    const std::lock_guard lock{lock_};
+
+    if (query.FilesFrom != -1) {
+      if (query.MatchNames) {
+        throw std::invalid_argument("Names cannot be matched in a list of files.");
+      }
+      searchFileList(query, onMatch, context);
+      return;
+    }
+
+    // Open the root before waking anyone up, so a bad root doesn't leave a search half started.
+    TraverseDirectoryJob root = TraverseDirectoryJob::FromPath(query.Root);
+
+    if (directoryCache_ != nullptr) {
+      // The workers are all parked, so this is the one time nobody is reading the cache.
+      directoryCache_->Refresh();
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+    scheduler_.Start(query.Needle, query.MatchNames);
+    scheduler_.SlowSubmit(std::move(root));
+    scheduler_.FinishSubmitting();
+
+    Delivery delivery{onMatch, context};
+    finish(delivery, start_time);
+  }
+
+ private:
+  /// @brief Where matches go. Once the callback throws, we stop calling it, but keep draining
+  ///        until the workers are done, since the next search frees everything the results point
+  ///        into.
+  struct Delivery {
+    Delivery(Searcher::MatchCallback onMatch, void* context) noexcept
+        : OnMatch(onMatch), Context(context) {}
+
+    Searcher::MatchCallback OnMatch;
+    void* Context;
+    std::exception_ptr Error;
+  };
+
+  void searchFileList(const Query& query, Searcher::MatchCallback onMatch, void* context) {
+    // Like the root job, opened before waking anyone up.
+    const int root_fd = open(query.Root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd == -1) {
+      throw std::system_error(errno, std::generic_category());
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+    scheduler_.Start(query.Needle);
+
+    // Matches are delivered between batches, so that a long list doesn't hold them all back.
+    Delivery delivery{onMatch, context};
+    std::exception_ptr list_error;
+    try {
+      FileListReader reader{query.FilesFrom};
+      FileListSubmitter submitter{scheduler_, root_fd};
+      std::vector<std::string> batch;
+      batch.reserve(kFileListBatchSize);
+      while (reader.ReadBatch(batch, kFileListBatchSize)) {
+        submitter.Submit(batch);
+        batch.clear();
+        while (deliver(delivery, scheduler_.GetResult(resultToken_))) {}
+      }
+    } catch (...) {
+      // Whatever was submitted is still searched. The search must finish either way.
+      list_error = std::current_exception();
+    }
+
+    // Every listed file has been opened, and the files don't need their directories.
+    close(root_fd);
+    scheduler_.FinishSubmitting();
+    finish(delivery, start_time);
+
+    if (list_error) {
+      std::rethrow_exception(list_error);
+    }
+  }
+
+  auto deliver(Delivery& delivery, std::optional<Result>&& result) -> bool {
+    if (!result.has_value()) {
+      return false;
+    }
+
+    if (!delivery.Error) {
+      try {
+        delivery.OnMatch(delivery.Context, Match{result->Node()});
+      } catch (...) {
+        delivery.Error = std::current_exception();
+      }
+    }
+    return true;
+  }
+
+  /// @brief Delivers matches until the workers are done, once everything has been submitted.
+  void finish(Delivery& delivery, std::chrono::steady_clock::time_point startTime) {
+    const std::shared_future<void> completion = scheduler_.Completion();
+
+    while (true) {
+      if (deliver(delivery, scheduler_.GetResult(resultToken_))) {
+        continue;
+      }
+
+      // There is nothing to deliver right now. Rather than spinning on the result queue and
+      // stealing a core from the workers, block on the completion for a little while.
+      if (completion.wait_for(kResultPollInterval) == std::future_status::ready) {
+        break;
+      }
+    }
+
+    // Don't forget to flush any remaining results.
+    while (deliver(delivery, scheduler_.GetResult(resultToken_))) {}
+
+    scheduler_.WaitIdle();
+    busyTime_ += std::chrono::steady_clock::now() - startTime;
+
+    if (delivery.Error) {
+      std::rethrow_exception(delivery.Error);
+    }
+  }
+
+ public:
+  void WriteStats(std::ostream& out, stats::Format format) const override {
+    if constexpr (StatsPolicy::kEnabled) {
+      const std::lock_guard lock{lock_};
+      stats::Write(out, format, scheduler_.CollectStats(busyTime_));
+    } else {
+      throw std::logic_error("Statistics were not enabled for this pool.");
+    }
+  }
+
+  void WriteTrace(std::ostream& out) const override {
+    const std::lock_guard lock{lock_};
+    scheduler_.WriteTrace(out);
+  }
+
+ private:
+  /// @brief Serializes searches, in the order they were asked for.
+  mutable sync::TicketLock lock_;
+  std::unique_ptr<DirectoryCache> directoryCache_;
+  Scheduler<std::allocator<std::byte>, StatsPolicy> scheduler_;
+  moodycamel::ConsumerToken resultToken_{scheduler_.ResultToken()};
+  /// @brief Time spent in searches, which stands in for the wall time in the statistics.
+  std::chrono::nanoseconds busyTime_{0};
+};
+
+}  // namespace
+
+Searcher::Searcher(PoolOptions options) {
+  if (options.Threads == 0) {
+    throw std::invalid_argument("A searcher needs at least one thread.");
+  }
+
+  // Statistics are compiled into a separate instantiation of the scheduler, so that the default
+  // path doesn't pay for them.
+  if (options.CollectStats) {
+    impl_ = std::make_unique<PoolImpl<stats::Enabled>>(options);
+  } else {
+    impl_ = std::make_unique<PoolImpl<stats::Disabled>>(options);
+  }
+}
+
+Searcher::~Searcher() = default;
+
+void Searcher::search(const Query& query, MatchCallback onMatch, void* context) {
+  impl_->Search(query, onMatch, context);
+}
+
+void Searcher::WriteStats(std::ostream& out, stats::Format format) const {
+  impl_->WriteStats(out, format);
+}
+
+void Searcher::WriteTrace(std::ostream& out) const { impl_->WriteTrace(out); }
+
+}  // namespace rbs
@@ -0,0 +1,86 @@
+#ifndef RBS_SIZE_CLASS_QUEUE_HPP
+#define RBS_SIZE_CLASS_QUEUE_HPP
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include "concurrentqueue.h"
+
+namespace rbs {
+
+/// @brief A set of concurrent FIFO queues, one per size class.
+///
+/// Consumers which drain the classes in order get an approximation of a priority queue, without
+/// paying for a concurrent heap. Class 0 has the highest priority.
+template <class T, std::size_t Classes>
+class SizeClassQueue {
+ private:
+  using Queue = moodycamel::ConcurrentQueue<T>;
+
+ public:
+  static constexpr std::size_t kClasses = Classes;
+
+  using ProducerTokens = std::array<moodycamel::ProducerToken, Classes>;
+  using ConsumerTokens = std::array<moodycamel::ConsumerToken, Classes>;
+
+  SizeClassQueue() = default;
+
+  SizeClassQueue(const SizeClassQueue&) = delete;
+  SizeClassQueue(SizeClassQueue&&) = delete;
+  auto operator=(const SizeClassQueue&) -> SizeClassQueue& = delete;
+  auto operator=(SizeClassQueue&&) -> SizeClassQueue& = delete;
+  ~SizeClassQueue() = default;
+
+  [[nodiscard]] auto MakeProducerTokens() -> ProducerTokens {
+    return makeTokens<moodycamel::ProducerToken>(std::make_index_sequence<Classes>{});
+  }
+
+  [[nodiscard]] auto MakeConsumerTokens() -> ConsumerTokens {
+    return makeTokens<moodycamel::ConsumerToken>(std::make_index_sequence<Classes>{});
+  }
+
+  constexpr auto Enqueue(ProducerTokens& tokens, std::size_t sizeClass, T&& item) -> bool {
+    return queues_[sizeClass].enqueue(tokens[sizeClass], std::move(item));
+  }
+
+  constexpr auto Enqueue(std::size_t sizeClass, T&& item) -> bool {
+    return queues_[sizeClass].enqueue(std::move(item));
+  }
+
+  template <class InputIt>
+  constexpr auto EnqueueBulk(ProducerTokens& tokens, std::size_t sizeClass, InputIt items,
+                             std::size_t count) -> bool {
+    return queues_[sizeClass].enqueue_bulk(tokens[sizeClass], items, count);
+  }
+
+  constexpr auto TryDequeue(ConsumerTokens& tokens, std::size_t sizeClass, T& item) -> bool {
+    return queues_[sizeClass].try_dequeue(tokens[sizeClass], item);
+  }
+
+  template <class OutputIt>
+  constexpr auto TryDequeueBulk(ConsumerTokens& tokens, std::size_t sizeClass, OutputIt items,
+                                std::size_t max) -> std::size_t {
+    return queues_[sizeClass].try_dequeue_bulk(tokens[sizeClass], items, max);
+  }
+
+  /// @brief Returns an estimate of the number of items across all classes.
+  [[nodiscard]] constexpr auto SizeApprox() const -> std::size_t {
+    std::size_t size = 0;
+    for (const Queue& queue : queues_) {
+      size += queue.size_approx();
+    }
+    return size;
+  }
+
+ private:
+  template <class Token, std::size_t... Indices>
+  auto makeTokens(std::index_sequence<Indices...> /*unused*/) -> std::array<Token, Classes> {
+    return {Token(queues_[Indices])...};
+  }
+
+  std::array<Queue, Classes> queues_;
+};
+
+}  // namespace rbs
+
+#endif  // RBS_SIZE_CLASS_QUEUE_HPP
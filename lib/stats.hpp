@@ -0,0 +1,225 @@
+#ifndef RBS_STATS_HPP
+#define RBS_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <new>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace rbs::stats {
+
+enum class Counter : std::uint8_t {
+  DirectoriesRead,
+  EntriesSeen,
+  FilesOpened,
+  BytesScanned,
+  FilesMapped,
+  FilesRead,
+  FilesDecompressed,
+  DequeueMisses,
+  SpinIterations,
+  Parks,
+};
+
+inline constexpr std::size_t kCounterCount = 10;
+
+inline constexpr std::array<std::string_view, kCounterCount> kCounterNames{
+    "directories_read", "entries_seen",       "files_opened",   "bytes_scanned",
+    "files_mapped",     "files_read",         "files_decompressed", "dequeue_misses",
+    "spin_iterations",  "parks",
+};
+
+enum class Timer : std::uint8_t {
+  TraverseDirectory,
+  SearchFile,
+};
+
+inline constexpr std::size_t kTimerCount = 2;
+
+inline constexpr std::array<std::string_view, kTimerCount> kTimerNames{
+    "traverse_directory",
+    "search_file",
+};
+
+enum class Format : std::uint8_t {
+  None,
+  Text,
+  Json,
+};
+
+/// @brief Statistics policy which records nothing. Every call compiles away.
+class Disabled {
+ public:
+  static constexpr bool kEnabled = false;
+
+  class ScopedTimer {
+   public:
+    constexpr ScopedTimer(Disabled& /*unused*/, Timer /*unused*/) noexcept {}
+  };
+
+  constexpr void Add(Counter /*unused*/, std::uint64_t /*unused*/ = 1) noexcept {}
+};
+
+/// @brief Statistics policy which records into counters owned by a single worker.
+///
+/// The counters are plain integers, since only the owning worker writes them. They may only be
+/// read once the worker has been joined. The policy is padded to a cache line so that neighbouring
+/// workers don't false-share.
+class alignas(std::hardware_destructive_interference_size) Enabled {
+ public:
+  static constexpr bool kEnabled = true;
+
+  class ScopedTimer {
+   public:
+    constexpr ScopedTimer(Enabled& stats, Timer timer) noexcept
+        : stats_(&stats), timer_(timer), start_(std::chrono::steady_clock::now()) {}
+
+    constexpr ScopedTimer(const ScopedTimer&) = delete;
+    constexpr ScopedTimer(ScopedTimer&&) = delete;
+    constexpr auto operator=(const ScopedTimer&) -> ScopedTimer& = delete;
+    constexpr auto operator=(ScopedTimer&&) -> ScopedTimer& = delete;
+
+    constexpr ~ScopedTimer() noexcept {
+      const auto elapsed = std::chrono::steady_clock::now() - start_;
+      const auto index = static_cast<std::size_t>(timer_);
+      stats_->timeNs_[index] += static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      stats_->calls_[index] += 1;
+    }
+
+   private:
+    Enabled* stats_;
+    Timer timer_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  constexpr void Add(Counter counter, std::uint64_t count = 1) noexcept {
+    counters_[static_cast<std::size_t>(counter)] += count;
+  }
+
+  [[nodiscard]] constexpr auto Get(Counter counter) const noexcept -> std::uint64_t {
+    return counters_[static_cast<std::size_t>(counter)];
+  }
+
+  [[nodiscard]] constexpr auto TimeNs(Timer timer) const noexcept -> std::uint64_t {
+    return timeNs_[static_cast<std::size_t>(timer)];
+  }
+
+  [[nodiscard]] constexpr auto Calls(Timer timer) const noexcept -> std::uint64_t {
+    return calls_[static_cast<std::size_t>(timer)];
+  }
+
+  constexpr void Accumulate(const Enabled& other) noexcept {
+    for (std::size_t i = 0; i < kCounterCount; ++i) {
+      counters_[i] += other.counters_[i];
+    }
+    for (std::size_t i = 0; i < kTimerCount; ++i) {
+      timeNs_[i] += other.timeNs_[i];
+      calls_[i] += other.calls_[i];
+    }
+  }
+
+ private:
+  std::array<std::uint64_t, kCounterCount> counters_{};
+  std::array<std::uint64_t, kTimerCount> timeNs_{};
+  std::array<std::uint64_t, kTimerCount> calls_{};
+};
+
+/// @brief Everything a report is made of, collected once all workers have been joined.
+struct Snapshot {
+  std::vector<Enabled> Workers;
+  std::chrono::nanoseconds WallTime{0};
+
+  std::uint64_t FdSoftLimit = 0;
+  std::uint64_t FdHardLimit = 0;
+  bool FdLimitRaised = false;
+  std::uint64_t FdCeiling = 0;
+  std::uint64_t FdTarget = 0;
+  std::uint64_t FdAdjustments = 0;
+  std::uint64_t FdExhausted = 0;
+};
+
+namespace detail {
+
+inline void writeText(std::ostream& out, const Snapshot& snapshot, const Enabled& totals) {
+  out << std::format("rbs stats: {} workers, {:.3f} ms wall\n", snapshot.Workers.size(),
+                     static_cast<double>(snapshot.WallTime.count()) / 1e6);
+
+  for (std::size_t i = 0; i < kCounterCount; ++i) {
+    out << std::format("  {:<24}{}\n", kCounterNames[i], totals.Get(static_cast<Counter>(i)));
+  }
+
+  for (std::size_t i = 0; i < kTimerCount; ++i) {
+    const auto timer = static_cast<Timer>(i);
+    out << std::format("  {:<24}{} jobs, {:.3f} ms\n", kTimerNames[i], totals.Calls(timer),
+                       static_cast<double>(totals.TimeNs(timer)) / 1e6);
+  }
+
+  out << std::format(
+      "  fd budget               soft limit {}{}, hard limit {}, ceiling {}, final target {}, "
+      "{} adjustments, {} EMFILE/ENFILE\n",
+      snapshot.FdSoftLimit, snapshot.FdLimitRaised ? " (raised)" : "", snapshot.FdHardLimit,
+      snapshot.FdCeiling, snapshot.FdTarget, snapshot.FdAdjustments, snapshot.FdExhausted);
+}
+
+inline void writeJsonStats(std::ostream& out, const Enabled& stats) {
+  out << "{";
+  for (std::size_t i = 0; i < kCounterCount; ++i) {
+    out << std::format("\"{}\":{},", kCounterNames[i], stats.Get(static_cast<Counter>(i)));
+  }
+  for (std::size_t i = 0; i < kTimerCount; ++i) {
+    const auto timer = static_cast<Timer>(i);
+    out << std::format("\"{}_jobs\":{},\"{}_ns\":{}", kTimerNames[i], stats.Calls(timer),
+                       kTimerNames[i], stats.TimeNs(timer));
+    out << (i + 1 < kTimerCount ? "," : "");
+  }
+  out << "}";
+}
+
+inline void writeJson(std::ostream& out, const Snapshot& snapshot, const Enabled& totals) {
+  out << std::format("{{\"wall_ns\":{},\"fd_budget\":{{", snapshot.WallTime.count());
+  out << std::format(
+      "\"soft_limit\":{},\"hard_limit\":{},\"raised\":{},\"ceiling\":{},\"final_target\":{},"
+      "\"adjustments\":{},\"exhausted\":{}}},",
+      snapshot.FdSoftLimit, snapshot.FdHardLimit, snapshot.FdLimitRaised, snapshot.FdCeiling,
+      snapshot.FdTarget, snapshot.FdAdjustments, snapshot.FdExhausted);
+
+  out << "\"totals\":";
+  writeJsonStats(out, totals);
+
+  out << ",\"workers\":[";
+  for (std::size_t i = 0; i < snapshot.Workers.size(); ++i) {
+    writeJsonStats(out, snapshot.Workers[i]);
+    out << (i + 1 < snapshot.Workers.size() ? "," : "");
+  }
+  out << "]}\n";
+}
+
+}  // namespace detail
+
+inline void Write(std::ostream& out, Format format, const Snapshot& snapshot) {
+  Enabled totals;
+  for (const Enabled& worker : snapshot.Workers) {
+    totals.Accumulate(worker);
+  }
+
+  switch (format) {
+    case Format::None:
+      return;
+    case Format::Text:
+      detail::writeText(out, snapshot, totals);
+      return;
+    case Format::Json:
+      detail::writeJson(out, snapshot, totals);
+      return;
+  }
+}
+
+}  // namespace rbs::stats
+
+#endif  // RBS_STATS_HPP
@@ -0,0 +1,91 @@
+#ifndef RBS_SYNC_BALANCE_HPP
+#define RBS_SYNC_BALANCE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <ranges>
+
+namespace rbs::sync {
+
+/// @brief A pair of monotonically increasing counters tracking how many units of work a thread
+///        opened and how many it closed.
+///
+/// The counters never decrease, so they do not wrap in any realistic run, and each shard has a
+/// single writer, so updates are a plain load/store pair rather than a locked read-modify-write.
+/// The balance of a set of shards is only meaningful when summed; see IsQuiescent.
+class BalanceShard {
+ public:
+  constexpr void Open(std::uint64_t count = 1) noexcept {
+    opened_.store(opened_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  constexpr void Close(std::uint64_t count = 1) noexcept {
+    closed_.store(closed_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  /// @brief Variant of Open for shards which are written by more than one thread.
+  constexpr void SharedOpen(std::uint64_t count = 1) noexcept {
+    opened_.fetch_add(count, std::memory_order_release);
+  }
+
+  /// @brief Variant of Close for shards which are written by more than one thread.
+  constexpr void SharedClose(std::uint64_t count = 1) noexcept {
+    closed_.fetch_add(count, std::memory_order_release);
+  }
+
+  [[nodiscard]] constexpr auto Opened() const noexcept -> std::uint64_t {
+    return opened_.load(std::memory_order_acquire);
+  }
+
+  [[nodiscard]] constexpr auto Closed() const noexcept -> std::uint64_t {
+    return closed_.load(std::memory_order_acquire);
+  }
+
+ private:
+  std::atomic<std::uint64_t> opened_{0};
+  std::atomic<std::uint64_t> closed_{0};
+};
+
+/// @brief Estimates the number of units currently open across all shards.
+///
+/// The shards are not read atomically with respect to each other, so the result is only an
+/// approximation, and may transiently be negative.
+template <std::ranges::input_range Shards, class Projection>
+[[nodiscard]] constexpr auto Outstanding(Shards&& shards, Projection proj) noexcept
+    -> std::int64_t {
+  std::int64_t outstanding = 0;
+  for (const auto& shard : shards) {
+    const BalanceShard& balance = std::invoke(proj, shard);
+    outstanding += static_cast<std::int64_t>(balance.Opened() - balance.Closed());
+  }
+  return outstanding;
+}
+
+/// @brief Returns whether every unit of work ever opened across the shards has been closed.
+///
+/// All closed counters are collected first, then all opened counters. Since a unit is always
+/// opened before it is closed, and new units are only opened by units which are still open, the
+/// closed sum can only equal the opened sum if there was an instant between the two collections at
+/// which nothing was open. Once that is true it stays true until someone outside of the shards
+/// opens new work.
+template <std::ranges::forward_range Shards, class Projection>
+[[nodiscard]] constexpr auto IsQuiescent(Shards&& shards, Projection proj) noexcept -> bool {
+  std::uint64_t closed = 0;
+  for (const auto& shard : shards) {
+    closed += std::invoke(proj, shard).Closed();
+  }
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  std::uint64_t opened = 0;
+  for (const auto& shard : shards) {
+    opened += std::invoke(proj, shard).Opened();
+  }
+
+  return opened == closed;
+}
+
+}  // namespace rbs::sync
+
+#endif  // RBS_SYNC_BALANCE_HPP
@@ -0,0 +1,17 @@
+#ifndef RBS_SYNC_CPU_RELAX_HPP
+#define RBS_SYNC_CPU_RELAX_HPP
+
+namespace rbs::sync {
+
+/// @brief Hints to the CPU that we are in a spin-wait loop.
+inline void CpuRelax() noexcept {
+#if defined(__aarch64__) || defined(__arm__)
+  __asm__ volatile("yield");
+#elif defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+}  // namespace rbs::sync
+
+#endif  // RBS_SYNC_CPU_RELAX_HPP
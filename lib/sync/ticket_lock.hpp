@@ -0,0 +1,36 @@
+#ifndef RBS_SYNC_TICKET_LOCK_HPP
+#define RBS_SYNC_TICKET_LOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace rbs::sync {
+
+/// @brief A mutex which is handed out in the order it was asked for.
+///
+/// std::mutex makes no promise about who gets it next, so a thread which keeps relocking it can
+/// starve everyone else. Waiters sleep rather than spin, since they may wait for a whole search.
+class TicketLock {
+ public:
+  void lock() noexcept {
+    const std::uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+    std::uint32_t serving = serving_.load(std::memory_order_acquire);
+    while (serving != ticket) {
+      serving_.wait(serving, std::memory_order_acquire);
+      serving = serving_.load(std::memory_order_acquire);
+    }
+  }
+
+  void unlock() noexcept {
+    serving_.fetch_add(1, std::memory_order_release);
+    serving_.notify_all();
+  }
+
+ private:
+  std::atomic<std::uint32_t> next_{0};
+  std::atomic<std::uint32_t> serving_{0};
+};
+
+}  // namespace rbs::sync
+
+#endif  // RBS_SYNC_TICKET_LOCK_HPP
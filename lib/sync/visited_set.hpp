@@ -0,0 +1,148 @@
+#ifndef RBS_SYNC_VISITED_SET_HPP
+#define RBS_SYNC_VISITED_SET_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_set>
+#include "sync/cpu_relax.hpp"
+
+namespace rbs::sync {
+
+/// @brief A concurrent set of (device, inode) pairs, used to visit every directory or file once.
+///
+/// The set is split into shards, each an open addressing table which is only ever inserted into,
+/// so that inserting is a compare-and-swap on a slot that no other thread is likely to touch. The
+/// tables don't grow. Once a key's probe window is full, it goes into its shard's overflow set
+/// instead, which takes a lock. Slots never become empty again, so every thread inserting the
+/// same key sees the same full window, and agrees on where the key lives.
+///
+/// @note Inode numbers are assumed to never be zero, which marks an empty slot.
+class VisitedSet {
+ private:
+  static constexpr std::size_t kShards = 64;
+
+  /// @brief How many slots we probe before giving up and going to the overflow set.
+  static constexpr std::size_t kProbeWindow = 32;
+
+  /// @brief Marks a slot whose inode has been claimed, but whose device is yet to be written.
+  static constexpr std::uint64_t kPendingDevice = ~std::uint64_t{0};
+
+ public:
+  /// @param capacity Number of keys expected. More fit, but past this they start to take a lock.
+  explicit VisitedSet(std::size_t capacity)
+      : slotsPerShard_(
+            std::bit_ceil(std::max<std::size_t>(2 * capacity / kShards, kProbeWindow))),
+        shards_(std::make_unique<Shard[]>(kShards)) {
+    for (std::size_t i = 0; i < kShards; ++i) {
+      shards_[i].Slots = std::make_unique<Slot[]>(slotsPerShard_);
+    }
+  }
+
+  /// @brief Adds a key. Returns true if it wasn't in the set yet.
+  [[nodiscard]] auto Insert(std::uint64_t device, std::uint64_t inode) noexcept -> bool {
+    const std::uint64_t hash = mix(device, inode);
+    Shard& shard = shards_[hash % kShards];
+    const std::size_t mask = slotsPerShard_ - 1;
+
+    // The shard took the low bits, so probe with the rest.
+    std::size_t index = static_cast<std::size_t>(hash / kShards) & mask;
+    for (std::size_t probe = 0; probe < kProbeWindow; ++probe, index = (index + 1) & mask) {
+      Slot& slot = shard.Slots[index];
+
+      std::uint64_t current = slot.Inode.load(std::memory_order_acquire);
+      if (current == 0) {
+        if (slot.Inode.compare_exchange_strong(current, inode, std::memory_order_acq_rel,
+                                               std::memory_order_acquire)) {
+          slot.Device.store(device, std::memory_order_release);
+          return true;
+        }
+        // Someone beat us to this slot. It may have been with our own key.
+      }
+
+      if (current == inode && deviceOf(slot) == device) {
+        return false;
+      }
+    }
+
+    const std::lock_guard lock{shard.OverflowMutex};
+    return shard.Overflow.emplace(hash, device, inode).second;
+  }
+
+  /// @brief Empties the set.
+  ///
+  /// @note No other thread may be inserting.
+  void Clear() noexcept {
+    for (std::size_t i = 0; i < kShards; ++i) {
+      Shard& shard = shards_[i];
+      for (std::size_t j = 0; j < slotsPerShard_; ++j) {
+        shard.Slots[j].Inode.store(0, std::memory_order_relaxed);
+        shard.Slots[j].Device.store(kPendingDevice, std::memory_order_relaxed);
+      }
+      shard.Overflow.clear();
+    }
+  }
+
+ private:
+  struct Slot {
+    std::atomic<std::uint64_t> Inode{0};
+    std::atomic<std::uint64_t> Device{kPendingDevice};
+  };
+
+  struct OverflowKey {
+    std::uint64_t Hash;
+    std::uint64_t Device;
+    std::uint64_t Inode;
+
+    OverflowKey(std::uint64_t hash, std::uint64_t device, std::uint64_t inode) noexcept
+        : Hash(hash), Device(device), Inode(inode) {}
+
+    [[nodiscard]] auto operator==(const OverflowKey& other) const noexcept -> bool {
+      return Device == other.Device && Inode == other.Inode;
+    }
+  };
+
+  struct OverflowHash {
+    [[nodiscard]] auto operator()(const OverflowKey& key) const noexcept -> std::size_t {
+      return static_cast<std::size_t>(key.Hash);
+    }
+  };
+
+  struct alignas(std::hardware_destructive_interference_size) Shard {
+    std::unique_ptr<Slot[]> Slots;
+    std::mutex OverflowMutex;
+    std::unordered_set<OverflowKey, OverflowHash> Overflow;
+  };
+
+  /// @brief Waits out the moment between another thread claiming a slot and writing its device.
+  [[nodiscard]] static auto deviceOf(const Slot& slot) noexcept -> std::uint64_t {
+    std::uint64_t device = slot.Device.load(std::memory_order_acquire);
+    while (device == kPendingDevice) {
+      CpuRelax();
+      device = slot.Device.load(std::memory_order_acquire);
+    }
+    return device;
+  }
+
+  /// @brief Inodes on one device are mostly sequential, so they need mixing to spread over the
+  ///        shards. This is the splitmix64 finalizer.
+  [[nodiscard]] static constexpr auto mix(std::uint64_t device, std::uint64_t inode) noexcept
+      -> std::uint64_t {
+    std::uint64_t hash = inode ^ std::rotl(device, 32);
+    hash = (hash ^ (hash >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27U)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31U);
+  }
+
+  std::size_t slotsPerShard_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+}  // namespace rbs::sync
+
+#endif  // RBS_SYNC_VISITED_SET_HPP
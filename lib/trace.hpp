@@ -0,0 +1,171 @@
+#ifndef RBS_TRACE_HPP
+#define RBS_TRACE_HPP
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string_view>
+
+namespace rbs::trace {
+
+enum class Event : std::uint8_t {
+  TraverseDirectory,
+  SearchFile,
+  Idle,
+};
+
+inline constexpr std::array<std::string_view, 3> kEventNames{
+    "traverse_directory",
+    "search_file",
+    "idle",
+};
+
+struct Record {
+  std::uint64_t StartNs;
+  std::uint64_t DurationNs;
+  /// @brief Event specific argument. The file size for SearchFile, unused otherwise.
+  std::uint64_t Arg;
+  Event Kind;
+};
+
+/// @brief A fixed-capacity ring of trace records with a single writer.
+///
+/// Once full, the oldest records are overwritten, so memory use and the cost of recording stay
+/// bounded no matter how large the tree is. Only one in every @p sampleEvery events is recorded.
+class RingBuffer {
+ public:
+  RingBuffer(std::size_t capacity, std::uint32_t sampleEvery,
+             std::chrono::steady_clock::time_point epoch)
+      : records_(std::make_unique<Record[]>(std::bit_ceil(capacity))),
+        mask_(std::bit_ceil(capacity) - 1),
+        sampleEvery_(sampleEvery == 0 ? 1 : sampleEvery),
+        epoch_(epoch) {}
+
+  RingBuffer(const RingBuffer&) = delete;
+  RingBuffer(RingBuffer&&) = delete;
+  auto operator=(const RingBuffer&) -> RingBuffer& = delete;
+  auto operator=(RingBuffer&&) -> RingBuffer& = delete;
+  ~RingBuffer() = default;
+
+  /// @brief Decides whether the next event should be recorded.
+  [[nodiscard]] auto Sample() noexcept -> bool {
+    if (++sampleCounter_ < sampleEvery_) {
+      return false;
+    }
+    sampleCounter_ = 0;
+    return true;
+  }
+
+  /// @brief Nanoseconds since the start of the trace.
+  [[nodiscard]] auto Now() const noexcept -> std::uint64_t {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                             epoch_)
+            .count());
+  }
+
+  void Push(const Record& record) noexcept {
+    const std::uint64_t head = head_.load(std::memory_order_relaxed);
+    records_[head & mask_] = record;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  /// @brief Invokes @p callback on every record still in the ring, oldest first.
+  template <class Callback>
+  void ForEach(Callback&& callback) const {
+    const std::uint64_t head = head_.load(std::memory_order_acquire);
+    const std::uint64_t capacity = mask_ + 1;
+    for (std::uint64_t i = head > capacity ? head - capacity : 0; i < head; ++i) {
+      callback(records_[i & mask_]);
+    }
+  }
+
+  /// @brief Number of records which were overwritten before being written out.
+  [[nodiscard]] auto Dropped() const noexcept -> std::uint64_t {
+    const std::uint64_t head = head_.load(std::memory_order_acquire);
+    return head > mask_ + 1 ? head - (mask_ + 1) : 0;
+  }
+
+ private:
+  std::unique_ptr<Record[]> records_;
+  std::uint64_t mask_;
+  std::uint32_t sampleEvery_;
+  std::uint32_t sampleCounter_ = 0;
+  std::chrono::steady_clock::time_point epoch_;
+  std::atomic<std::uint64_t> head_{0};
+};
+
+/// @brief Records the lifetime of the enclosing scope into a ring buffer, if tracing is on and the
+///        event is sampled.
+class ScopedSpan {
+ public:
+  ScopedSpan(RingBuffer* buffer, Event kind, std::uint64_t arg = 0) noexcept
+      : buffer_(buffer != nullptr && buffer->Sample() ? buffer : nullptr),
+        kind_(kind),
+        arg_(arg),
+        start_(buffer_ != nullptr ? buffer_->Now() : 0) {}
+
+  ScopedSpan(const ScopedSpan&) = delete;
+  ScopedSpan(ScopedSpan&&) = delete;
+  auto operator=(const ScopedSpan&) -> ScopedSpan& = delete;
+  auto operator=(ScopedSpan&&) -> ScopedSpan& = delete;
+
+  ~ScopedSpan() noexcept {
+    if (buffer_ != nullptr) {
+      buffer_->Push(Record{start_, buffer_->Now() - start_, arg_, kind_});
+    }
+  }
+
+ private:
+  RingBuffer* buffer_;
+  Event kind_;
+  std::uint64_t arg_;
+  std::uint64_t start_;
+};
+
+/// @brief Writes the buffers in the Chrome trace event format, one thread per buffer.
+///
+/// The output loads in chrome://tracing and Perfetto.
+inline void WriteChromeTrace(std::ostream& out,
+                             std::span<const std::unique_ptr<RingBuffer>> buffers) {
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+  bool first = true;
+  const auto separator = [&first]() -> std::string_view {
+    const bool was_first = first;
+    first = false;
+    return was_first ? "" : ",\n";
+  };
+
+  std::uint64_t dropped = 0;
+  for (std::size_t tid = 0; tid < buffers.size(); ++tid) {
+    out << std::format(
+        "{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},"
+        "\"args\":{{\"name\":\"worker {}\"}}}}",
+        separator(), tid, tid);
+
+    buffers[tid]->ForEach([&](const Record& record) {
+      out << std::format(
+          "{}{{\"name\":\"{}\",\"cat\":\"rbs\",\"ph\":\"X\",\"pid\":1,\"tid\":{},"
+          "\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{\"arg\":{}}}}}",
+          separator(), kEventNames[static_cast<std::size_t>(record.Kind)], tid,
+          static_cast<double>(record.StartNs) / 1e3, static_cast<double>(record.DurationNs) / 1e3,
+          record.Arg);
+    });
+
+    dropped += buffers[tid]->Dropped();
+  }
+
+  out << std::format("\n],\"otherData\":{{\"dropped_events\":{}}}}}\n", dropped);
+}
+
+}  // namespace rbs::trace
+
+#endif  // RBS_TRACE_HPP
@@ -0,0 +1,255 @@
+#ifndef RBS_WORKER_HPP
+#define RBS_WORKER_HPP
+
+#include <array>
+#include <atomic>
+#include <new>
+#include <span>
+#include <vector>
+#include "alloc/arena.hpp"
+#include "concurrentqueue.h"
+#include "dir_cache.hpp"
+#include "io/decompress.hpp"
+#include "jobs/traverse_directory_job.hpp"
+#include "name_batch.hpp"
+#include "result.hpp"
+#include "size_class_queue.hpp"
+#include "stats.hpp"
+#include "sync/balance.hpp"
+#include "sync/visited_set.hpp"
+#include "trace.hpp"
+
+namespace rbs {
+
+/// @brief Bookkeeping owned by a single worker.
+///
+/// Each worker only ever writes its own shard, so the shards are padded to keep workers from
+/// contending on each other's cache lines.
+struct alignas(std::hardware_destructive_interference_size) WorkerShard {
+  /// @brief Jobs submitted and jobs serviced. Used to detect when all work is done.
+  sync::BalanceShard Jobs;
+  /// @brief File descriptors opened for searching, and closed.
+  sync::BalanceShard Files;
+  /// @brief Directory handles submitted for traversal, and closed.
+  sync::BalanceShard Directories;
+};
+
+using SearchFileQueue = SizeClassQueue<SearchFileJob, SearchFileJob::kSizeClasses>;
+
+/// @tparam StatsPolicy Either stats::Enabled or stats::Disabled. Recording statistics is decided at
+///         compile time, so that it costs nothing when off.
+template <class Scheduler, class StatsPolicy = stats::Disabled>
+class Worker {
+ private:
+  static constexpr std::uint16_t kWorkCountLeakyBucketInitialValue = 1024;
+  static constexpr std::uint16_t kWorkCountLeakyBucketGain = 256;
+
+  /// @brief How many jobs we run between refreshes of our estimate of the open descriptor count.
+  ///
+  /// Summing the count means reading every other worker's shard, which is too expensive to do for
+  /// every job. The estimate is only used as a heuristic, so it is fine for it to be stale. Each
+  /// refresh also steps the descriptor budget's controller.
+  static constexpr std::uint32_t kFdsOpenRefreshInterval = 32;
+
+  /// @brief How many jobs we take at once from the smallest size class.
+  ///
+  /// Small files take about as long to search as it takes to dequeue them, so we dequeue them in
+  /// bulk. Near the end of a search, we take fewer, so that the tail is shared out.
+  static constexpr std::size_t kSmallFileBatchSize = 16;
+
+  /// @brief How many search jobs we hold on to, and have the kernel read in, ahead of the one we
+  ///        are searching.
+  static constexpr std::size_t kReadaheadDepth = 3;
+
+  /// @brief Files up to this size are read into our buffer rather than mapped. This matches the
+  ///        smallest size class, so the batched small files all take the cheap path.
+  static constexpr std::size_t kReadBufferSize = SearchFileJob::kSizeClassThresholds.back();
+
+  /// @brief How much decompressed output we search at a time.
+  static constexpr std::size_t kDecompressWindowSize = 256ULL * 1024ULL;
+
+  static constexpr Logger kLogger{"Worker"};
+
+ public:
+  explicit constexpr Worker(Scheduler* scheduler,
+                            moodycamel::ProducerToken&& directoryProducerToken,
+                            moodycamel::ConsumerToken&& directoryConsumerToken,
+                            SearchFileQueue::ProducerTokens&& fileSearchProducerTokens,
+                            SearchFileQueue::ConsumerTokens&& fileSearchConsumerTokens,
+                            moodycamel::ProducerToken&& resultProducerToken,
+                            alloc::MPArena<FsNode>* directoryArena, WorkerShard* shard,
+                            trace::RingBuffer* traceBuffer) noexcept
+      : fsNodeArena_(directoryArena),
+        scheduler_(scheduler),
+        shard_(shard),
+        trace_(traceBuffer),
+        directoryProducerToken_(std::move(directoryProducerToken)),
+        directoryConsumerToken_(std::move(directoryConsumerToken)),
+        fileSearchProducerTokens_(std::move(fileSearchProducerTokens)),
+        fileSearchConsumerTokens_(std::move(fileSearchConsumerTokens)),
+        resultProducerToken_(std::move(resultProducerToken)) {}
+
+  constexpr Worker(const Worker&) = delete;
+  constexpr Worker(Worker&&) = default;
+  constexpr auto operator=(const Worker&) -> Worker& = delete;
+  constexpr auto operator=(Worker&&) -> Worker& = default;
+
+  [[nodiscard]] constexpr auto Allocator() const noexcept { return scheduler_->allocator_; }
+
+  [[nodiscard]] constexpr auto Allocator() noexcept { return scheduler_->allocator_; }
+
+  [[nodiscard]] constexpr auto GetTraverseDirectoryJob() noexcept -> TraverseDirectoryJob;
+
+  [[nodiscard]] constexpr auto GetSearchFileJob() noexcept -> SearchFileJob;
+
+  [[nodiscard]] constexpr auto FsNodeArena() const noexcept -> const alloc::MPArena<FsNode>* {
+    return fsNodeArena_;
+  }
+
+  [[nodiscard]] constexpr auto FsNodeArena() noexcept -> alloc::MPArena<FsNode>* {
+    return fsNodeArena_;
+  }
+
+  /// @brief Returns where to cache directory listings across searches, or nullptr if we don't.
+  [[nodiscard]] constexpr auto DirectoryCache() const noexcept -> rbs::DirectoryCache* {
+    return scheduler_->options_.DirectoryCache;
+  }
+
+  [[nodiscard]] constexpr auto Stats() noexcept -> StatsPolicy& { return stats_; }
+
+  [[nodiscard]] constexpr auto Stats() const noexcept -> const StatsPolicy& { return stats_; }
+
+  [[nodiscard]] constexpr auto SearchString() const noexcept -> std::string_view {
+    return scheduler_->searchString_;
+  }
+
+  [[nodiscard]] constexpr auto SearchString() noexcept -> std::string_view {
+    return scheduler_->searchString_;
+  }
+
+  /// @brief Scratch space for reading small files into.
+  [[nodiscard]] constexpr auto ReadBuffer() noexcept -> std::span<char> { return readBuffer_; }
+
+  /// @brief Returns whether compressed files are searched through their decompressed contents.
+  [[nodiscard]] constexpr auto SearchCompressed() const noexcept -> bool {
+    return scheduler_->options_.SearchCompressed;
+  }
+
+  /// @brief Returns whether the current search looks for the needle in entry names, in which case
+  ///        no file is opened.
+  [[nodiscard]] constexpr auto MatchNames() const noexcept -> bool {
+    return scheduler_->matchNames_;
+  }
+
+  /// @brief Names of the directory being traversed, waiting to be matched, when MatchNames.
+  [[nodiscard]] constexpr auto Names() noexcept -> NameBatch& { return nameBatch_; }
+
+  [[nodiscard]] constexpr auto FollowSymlinks() const noexcept -> bool {
+    return scheduler_->options_.FollowSymlinks;
+  }
+
+  [[nodiscard]] constexpr auto DedupeFiles() const noexcept -> bool {
+    return scheduler_->options_.DedupeFiles;
+  }
+
+  /// @brief Returns the set of directories and files visited so far, or nullptr if neither
+  ///        FollowSymlinks nor DedupeFiles is on.
+  [[nodiscard]] constexpr auto Visited() noexcept -> sync::VisitedSet* {
+    return scheduler_->visited_.get();
+  }
+
+  [[nodiscard]] constexpr auto Decompressor() noexcept -> io::Decompressor& {
+    return decompressor_;
+  }
+
+  /// @brief Scratch space which decompressed output is searched in, with room to carry the last
+  ///        overlap bytes of one chunk over to the next.
+  /// @brief Returns a buffer for decompressed output, with room for overlap more bytes, or an
+  ///        empty span if there is no memory for it.
+  [[nodiscard]] auto DecompressWindow(std::size_t overlap) noexcept -> std::span<char> {
+    // Only allocated once we come across a compressed file, and only grows for long needles.
+    if (decompressWindow_.size() < kDecompressWindowSize + overlap) {
+      try {
+        decompressWindow_.resize(kDecompressWindowSize + overlap);
+      } catch (const std::bad_alloc&) {
+        kLogger.Error("Failed to allocate a window to decompress into.");
+        return {};
+      }
+    }
+    return decompressWindow_;
+  }
+
+  constexpr void PushResult(Result result) noexcept {
+    scheduler_->resultQueue_.enqueue(resultProducerToken_, std::move(result));
+  }
+
+  constexpr void OpenFile() noexcept { shard_->Files.Open(); }
+
+  /// @brief Returns an estimate of the number of descriptors currently open across all workers.
+  [[nodiscard]] constexpr auto FdsOpen() const noexcept -> std::uint64_t {
+    return fdsOpenEstimate_;
+  }
+
+  constexpr void FinishVisitingFile() noexcept { shard_->Files.Close(); }
+
+  /// @brief Records that an open failed because we ran out of descriptors.
+  constexpr void ReportFdsExhausted() noexcept { scheduler_->fdBudget_.ReportExhausted(); }
+
+  constexpr void Submit(TraverseDirectoryJob&& job) noexcept {
+    scheduler_->Submit(std::move(job), directoryProducerToken_, *shard_);
+  }
+
+  constexpr void Submit(SearchFileJob&& job) noexcept {
+    scheduler_->Submit(std::move(job), fileSearchProducerTokens_, *shard_);
+  }
+
+  /// @brief Services searches until the scheduler asks us to exit.
+  constexpr void Run();
+
+  constexpr auto TryDoJob() noexcept -> bool;
+  constexpr auto TryFileReadingJob() noexcept -> bool;
+  constexpr auto TryDirectoryTraversalJob() noexcept -> bool;
+
+ private:
+  /// @brief Services jobs until the current search is complete.
+  constexpr void runSearch();
+
+  /// @brief Gives the search jobs we dequeued, but haven't started on, back to the shared queue.
+  constexpr void returnHeldJobs() noexcept;
+
+  alloc::MPArena<FsNode>* fsNodeArena_;
+
+  Scheduler* scheduler_;
+  WorkerShard* shard_;
+  /// @brief Where to record trace events, or nullptr if tracing is off.
+  trace::RingBuffer* trace_;
+  moodycamel::ProducerToken directoryProducerToken_;
+  moodycamel::ConsumerToken directoryConsumerToken_;
+  SearchFileQueue::ProducerTokens fileSearchProducerTokens_;
+  SearchFileQueue::ConsumerTokens fileSearchConsumerTokens_;
+  moodycamel::ProducerToken resultProducerToken_;
+
+  std::array<SearchFileJob, kSmallFileBatchSize> smallFileBatch_;
+  std::size_t smallFileBatchHead_ = 0;
+  std::size_t smallFileBatchSize_ = 0;
+
+  std::array<SearchFileJob, kReadaheadDepth> readahead_;
+  std::size_t readaheadHead_ = 0;
+  std::size_t readaheadCount_ = 0;
+
+  std::array<char, kReadBufferSize> readBuffer_;
+
+  io::Decompressor decompressor_;
+  std::vector<char> decompressWindow_;
+
+  NameBatch nameBatch_;
+
+  [[no_unique_address]] StatsPolicy stats_;
+
+  std::uint64_t fdsOpenEstimate_ = 0;
+  std::uint32_t jobsSinceRefresh_ = 0;
+};
+
+}  // namespace rbs
+
+#endif  // RBS_WORKER_HPP
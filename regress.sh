@@ -0,0 +1,174 @@
+#!/bin/sh
+
+# Times rbs on generated corpora, checks its output, and compares against stored baselines.
+#
+# Usage: ./regress.sh [--update-baseline]
+#
+# Environment:
+#   PROFILES   Corpus profiles to run (default: "small-files wide large-files mixed")
+#   JOBS       Comma-separated -j values (default: 1,2,4,8)
+#   SEED       Corpus seed (default: 1)
+#   CACHE      "hot" to warm the page cache before timing, "cold" to drop it before every run.
+#              Dropping the cache needs sudo. (default: hot)
+#   THRESHOLD  Slowdown, in percent, past which a run is flagged as a regression (default: 10)
+#   FIFO_PROFILES  Profiles on which largest-first scheduling is also timed against --fifo, at
+#              the highest -j value (default: "large-files mixed")
+
+set -e
+
+PROFILES="${PROFILES:-small-files wide large-files mixed}"
+JOBS="${JOBS:-1,2,4,8}"
+SEED="${SEED:-1}"
+CACHE="${CACHE:-hot}"
+THRESHOLD="${THRESHOLD:-10}"
+FIFO_PROFILES="${FIFO_PROFILES:-large-files mixed}"
+NEEDLE="rbsneedle"
+# Generated names are dir<N> and file<N>.<EXT>, so this matches directories and files alike.
+NAME_NEEDLE="1"
+
+BUILD_DIR="./build/benchmark"
+RBS_PATH="$BUILD_DIR/rbs"
+GENCORPUS_PATH="$BUILD_DIR/rbs_gencorpus"
+CORPUS_DIR="$BUILD_DIR/corpus"
+RESULTS_DIR="./regress-results/$CACHE"
+BASELINE_DIR="./bench/baselines/$CACHE"
+
+UPDATE_BASELINE=0
+if [ "$1" = "--update-baseline" ]; then
+  UPDATE_BASELINE=1
+fi
+
+case "$CACHE" in
+  hot)
+    CACHE_ARGS="--warmup 3"
+    ;;
+  cold)
+    if [ "$(uname)" = "Darwin" ]; then
+      CACHE_ARGS="--prepare 'sync && sudo purge'"
+    else
+      CACHE_ARGS="--prepare 'sync && echo 3 | sudo tee /proc/sys/vm/drop_caches > /dev/null'"
+    fi
+    ;;
+  *)
+    echo "Unknown CACHE mode '$CACHE'. Use hot or cold." >&2
+    exit 2
+    ;;
+esac
+
+cmake --preset benchmark \
+  && ninja -C "$BUILD_DIR" rbs rbs_gencorpus
+
+mkdir -p "$RESULTS_DIR" "$BASELINE_DIR"
+
+status=0
+
+# Usage: check_output <EXPECTED> <ACTUAL> <WHAT>
+check_output() {
+  if ! diff -q "$1" "$2" > /dev/null; then
+    echo "WRONG OUTPUT: $3 differs from $1" >&2
+    status=1
+  fi
+}
+
+for profile in $PROFILES; do
+  corpus="$CORPUS_DIR/$profile-$SEED"
+
+  # Generation is deterministic, so an existing corpus for the same profile and seed is reused,
+  # as long as it has the lists older generators didn't write.
+  if [ ! -f "$corpus/manifest.txt" ] || [ ! -f "$corpus/entries.txt" ]; then
+    "$GENCORPUS_PATH" "$corpus" --profile "$profile" --seed "$SEED" --needle "$NEEDLE"
+  fi
+
+  for jobs in $(echo "$JOBS" | tr ',' ' '); do
+    # The generator sorts bytewise, so the locale's collation must not get a say.
+    "$RBS_PATH" "$corpus/tree" "$NEEDLE" -j "$jobs" | LC_ALL=C sort \
+      > "$RESULTS_DIR/$profile-$jobs.txt"
+    check_output "$corpus/expected.txt" "$RESULTS_DIR/$profile-$jobs.txt" "$profile with -j $jobs"
+  done
+
+  # --names finds every file and directory whose own name contains the needle.
+  awk -F/ -v needle="$NAME_NEEDLE" 'index($NF, needle)' "$corpus/entries.txt" \
+    > "$RESULTS_DIR/$profile-names-expected.txt"
+  "$RBS_PATH" "$corpus/tree" "$NAME_NEEDLE" --names | LC_ALL=C sort \
+    > "$RESULTS_DIR/$profile-names.txt"
+  check_output "$RESULTS_DIR/$profile-names-expected.txt" "$RESULTS_DIR/$profile-names.txt" \
+    "$profile with --names"
+
+  # --files-from, given every other file separated by NUL, finds the matches among those only.
+  awk 'NR % 2' "$corpus/files.txt" > "$RESULTS_DIR/$profile-files-from-list.txt"
+  sed 's|^|/|' "$RESULTS_DIR/$profile-files-from-list.txt" | LC_ALL=C sort \
+    | LC_ALL=C comm -12 - "$corpus/expected.txt" > "$RESULTS_DIR/$profile-files-from-expected.txt"
+  tr '\n' '\0' < "$RESULTS_DIR/$profile-files-from-list.txt" \
+    | "$RBS_PATH" "$corpus/tree" "$NEEDLE" --files-from - | LC_ALL=C sort \
+    > "$RESULTS_DIR/$profile-files-from.txt"
+  check_output "$RESULTS_DIR/$profile-files-from-expected.txt" \
+    "$RESULTS_DIR/$profile-files-from.txt" "$profile with --files-from"
+
+  eval hyperfine \
+    --runs 16 \
+    "$CACHE_ARGS" \
+    --parameter-list jobs "$JOBS" \
+    --export-csv "$RESULTS_DIR/$profile.csv" \
+    "'$RBS_PATH $corpus/tree $NEEDLE -j {jobs}'"
+
+  # Largest-first scheduling is there to shorten the tail, where everyone waits on the last big
+  # file. Where files vary in size, time it against plain FIFO order, with the most workers.
+  case " $FIFO_PROFILES " in
+    *" $profile "*)
+      max_jobs=$(echo "$JOBS" | tr ',' '\n' | sort -n | tail -n 1)
+      "$RBS_PATH" "$corpus/tree" "$NEEDLE" -j "$max_jobs" --fifo | LC_ALL=C sort \
+        > "$RESULTS_DIR/$profile-fifo.txt"
+      check_output "$corpus/expected.txt" "$RESULTS_DIR/$profile-fifo.txt" "$profile with --fifo"
+
+      eval hyperfine \
+        --runs 16 \
+        "$CACHE_ARGS" \
+        --export-csv "$RESULTS_DIR/$profile-fifo.csv" \
+        --command-name "'largest-first -j $max_jobs'" \
+        "'$RBS_PATH $corpus/tree $NEEDLE -j $max_jobs'" \
+        --command-name "'fifo -j $max_jobs'" \
+        "'$RBS_PATH $corpus/tree $NEEDLE -j $max_jobs --fifo'"
+
+      awk -F, -v profile="$profile" '
+        FNR == 1 { next }
+        { mean[FNR - 1] = $2; max[FNR - 1] = $NF }
+        END {
+          printf "%-12s largest-first %9.4fs (max %9.4fs) vs fifo %9.4fs (max %9.4fs)\n",
+                 profile, mean[1], max[1], mean[2], max[2]
+        }
+      ' "$RESULTS_DIR/$profile-fifo.csv"
+      ;;
+  esac
+
+  baseline="$BASELINE_DIR/$profile.csv"
+  if [ "$UPDATE_BASELINE" = 1 ]; then
+    cp "$RESULTS_DIR/$profile.csv" "$baseline"
+    echo "Recorded baseline $baseline"
+    continue
+  fi
+
+  # Timings only mean something against the same machine, so no baselines are checked in.
+  if [ ! -f "$baseline" ]; then
+    cp "$RESULTS_DIR/$profile.csv" "$baseline"
+    echo "NO BASELINE: recorded $baseline from this run, nothing was compared" >&2
+    continue
+  fi
+
+  # Match runs up by their -j value, which hyperfine puts in the last column, and compare means.
+  if ! awk -F, -v threshold="$THRESHOLD" -v profile="$profile" '
+    FNR == 1 { next }
+    NR == FNR { baseline[$NF] = $2; next }
+    ($NF in baseline) {
+      change = ($2 - baseline[$NF]) / baseline[$NF] * 100
+      verdict = change > threshold ? "REGRESSION" : "ok"
+      printf "%-12s %-12s -j %-4s %9.4fs -> %9.4fs (%+6.1f%%)\n", verdict, profile, $NF,
+             baseline[$NF], $2, change
+      if (change > threshold) { regressed = 1 }
+    }
+    END { exit regressed }
+  ' "$baseline" "$RESULTS_DIR/$profile.csv"; then
+    status=1
+  fi
+done
+
+exit $status
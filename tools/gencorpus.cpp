@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// Generates a deterministic directory tree to benchmark and test rbs against.
+//
+// The same profile, seed and overrides always produce byte-identical trees on every platform, since
+// all randomness comes from our own generator and integer-only distributions. Alongside the tree we
+// write the list of files containing the needle, in the format rbs prints them, to check rbs's
+// output against, and lists of every file and entry, to check the modes which don't search
+// contents.
+
+namespace rbs::gencorpus {
+
+namespace {
+
+struct Profile {
+  std::string_view Name;
+  /// @brief Number of directory levels below the root.
+  std::uint32_t Depth;
+  /// @brief Subdirectories per directory.
+  std::uint32_t Fanout;
+  /// @brief Files per directory.
+  std::uint32_t FilesPerDir;
+  /// @brief Smallest file size, in bytes.
+  std::uint64_t MinSize;
+  /// @brief Files never grow past this size, in bytes.
+  std::uint64_t MaxSize;
+  /// @brief Chance, in per mille, that a file's size doubles once more. Higher means a heavier
+  ///        tail of large files.
+  std::uint32_t SizeTailPerMille;
+  /// @brief Chance, in per mille, that a file contains the needle.
+  std::uint32_t MatchPerMille;
+  /// @brief Chance, in per mille, that a file is binary rather than text.
+  std::uint32_t BinaryPerMille;
+};
+
+constexpr std::uint64_t kKiB = 1024;
+constexpr std::uint64_t kMiB = 1024 * kKiB;
+
+constexpr std::array kProfiles{
+    // Source-tree like: deep, lots of small text files.
+    Profile{"small-files", 5, 4, 12, 256, 256 * kKiB, 400, 20, 20},
+    // Very wide and shallow, stressing directory traversal.
+    Profile{"wide", 2, 48, 24, 128, 64 * kKiB, 300, 10, 0},
+    // A few large, mostly binary files, like a build output or media directory.
+    Profile{"large-files", 2, 3, 4, 1 * kMiB, 256 * kMiB, 650, 50, 600},
+    // Mostly small files with the odd huge straggler.
+    Profile{"mixed", 4, 5, 10, 512, 128 * kMiB, 550, 30, 150},
+};
+
+/// @brief xoshiro256**, seeded through splitmix64.
+class Random {
+ public:
+  explicit constexpr Random(std::uint64_t seed) noexcept {
+    for (std::uint64_t& word : state_) {
+      seed += 0x9E3779B97F4A7C15ULL;
+      std::uint64_t mixed = seed;
+      mixed = (mixed ^ (mixed >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+      mixed = (mixed ^ (mixed >> 27U)) * 0x94D049BB133111EBULL;
+      word = mixed ^ (mixed >> 31U);
+    }
+  }
+
+  constexpr auto Next() noexcept -> std::uint64_t {
+    const std::uint64_t result = std::rotl(state_[1] * 5, 7) * 9;
+    const std::uint64_t shifted = state_[1] << 17U;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= shifted;
+    state_[3] = std::rotl(state_[3], 45);
+    return result;
+  }
+
+  /// @brief Uniform in [0, bound). Slightly biased for huge bounds, which doesn't matter here.
+  constexpr auto Below(std::uint64_t bound) noexcept -> std::uint64_t {
+    return bound == 0 ? 0 : Next() % bound;
+  }
+
+  constexpr auto Chance(std::uint32_t perMille) noexcept -> bool { return Below(1000) < perMille; }
+
+ private:
+  std::array<std::uint64_t, 4> state_{};
+};
+
+struct Options {
+  std::filesystem::path OutDir;
+  Profile TreeProfile = kProfiles.front();
+  std::uint64_t Seed = 1;
+  std::string Needle = "rbsneedle";
+};
+
+class Generator {
+ public:
+  explicit Generator(const Options& options) : options_(options), random_(options.Seed) {}
+
+  void Run() {
+    const std::filesystem::path tree = options_.OutDir / "tree";
+    std::filesystem::remove_all(options_.OutDir);
+    std::filesystem::create_directories(tree);
+
+    generateDirectory(tree, "", 0);
+
+    std::ranges::sort(matches_);
+    writeLines(options_.OutDir / "expected.txt", matches_);
+
+    // The files in the order they were written, without the leading separator, like a list for
+    // --files-from.
+    writeLines(options_.OutDir / "files.txt", fileList_);
+
+    std::ranges::sort(entries_);
+    writeLines(options_.OutDir / "entries.txt", entries_);
+
+    std::ofstream manifest{options_.OutDir / "manifest.txt", std::ios::binary};
+    manifest << std::format("profile={}\nseed={}\nneedle={}\nfiles={}\nbytes={}\nmatches={}\n",
+                            options_.TreeProfile.Name, options_.Seed, options_.Needle, files_,
+                            bytes_, matches_.size());
+  }
+
+ private:
+  static void writeLines(const std::filesystem::path& path, std::span<const std::string> lines) {
+    std::ofstream out{path, std::ios::binary};
+    for (const std::string& line : lines) {
+      out << line << '\n';
+    }
+  }
+
+  void generateDirectory(const std::filesystem::path& path, const std::string& relative,
+                         std::uint32_t level) {
+    const Profile& profile = options_.TreeProfile;
+
+    for (std::uint32_t i = 0; i < profile.FilesPerDir; ++i) {
+      const bool binary = random_.Chance(profile.BinaryPerMille);
+      const std::string name = std::format("file{}.{}", i, binary ? "bin" : "txt");
+      std::string entry = std::format("{}/{}", relative, name);
+      if (generateFile(path / name, binary)) {
+        matches_.push_back(entry);
+      }
+      fileList_.push_back(entry.substr(1));
+      entries_.push_back(std::move(entry));
+    }
+
+    if (level == profile.Depth) {
+      return;
+    }
+
+    for (std::uint32_t i = 0; i < profile.Fanout; ++i) {
+      const std::string name = std::format("dir{}", i);
+      std::filesystem::create_directory(path / name);
+      const std::string entry = std::format("{}/{}", relative, name);
+      entries_.push_back(entry);
+      generateDirectory(path / name, entry, level + 1);
+    }
+  }
+
+  /// @brief Writes one file, returning whether it contains the needle.
+  auto generateFile(const std::filesystem::path& path, bool binary) -> bool {
+    const Profile& profile = options_.TreeProfile;
+
+    // Log-uniform within each octave, with a geometric number of octaves above the minimum.
+    std::uint64_t octave_base = profile.MinSize;
+    while (octave_base * 2 <= profile.MaxSize && random_.Chance(profile.SizeTailPerMille)) {
+      octave_base *= 2;
+    }
+    const std::uint64_t size =
+        std::min(profile.MaxSize, octave_base + random_.Below(octave_base));
+
+    std::string content(size, '\0');
+    if (binary) {
+      for (char& byte : content) {
+        byte = static_cast<char>(random_.Next() & 0xFFU);
+      }
+    } else {
+      for (char& byte : content) {
+        const std::uint64_t roll = random_.Below(32);
+        byte = roll < 26 ? static_cast<char>('a' + roll) : (roll < 31 ? ' ' : '\n');
+      }
+    }
+
+    // Random bytes could contain the needle by accident, which would make the expected output
+    // wrong. Break up any occurrence.
+    for (std::size_t pos = content.find(options_.Needle); pos != std::string::npos;
+         pos = content.find(options_.Needle, pos)) {
+      content[pos] = static_cast<char>(content[pos] ^ 0x20);
+    }
+
+    const bool matches =
+        size >= options_.Needle.size() && random_.Chance(profile.MatchPerMille);
+    if (matches) {
+      const std::uint64_t offset = random_.Below(size - options_.Needle.size() + 1);
+      content.replace(offset, options_.Needle.size(), options_.Needle);
+    }
+
+    std::ofstream file{path, std::ios::binary};
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+
+    ++files_;
+    bytes_ += size;
+    return matches;
+  }
+
+  const Options& options_;
+  Random random_;
+  std::vector<std::string> matches_;
+  std::vector<std::string> fileList_;
+  /// @brief Every file and directory, in the format rbs prints them.
+  std::vector<std::string> entries_;
+  std::uint64_t files_ = 0;
+  std::uint64_t bytes_ = 0;
+};
+
+void printHelp() {
+  std::cout << "Usage: rbs_gencorpus <OUT_DIR> [OPTIONS]\n"
+            << "Options:\n"
+            << "  --profile <NAME>        One of:";
+  for (const Profile& profile : kProfiles) {
+    std::cout << ' ' << profile.Name;
+  }
+  std::cout << " (default: " << kProfiles.front().Name << ")\n"
+            << "  --seed <N>              Seed for the generator (default: 1)\n"
+            << "  --needle <STRING>       String planted in matching files (default: rbsneedle)\n"
+            << "  --depth <N>             Directory levels below the root\n"
+            << "  --fanout <N>            Subdirectories per directory\n"
+            << "  --files-per-dir <N>     Files per directory\n"
+            << "  --min-size <BYTES>      Smallest file size\n"
+            << "  --max-size <BYTES>      Largest file size\n"
+            << "  --size-tail <PERMILLE>  Chance of a file doubling in size, repeatedly\n"
+            << "  --match <PERMILLE>      Chance of a file containing the needle\n"
+            << "  --binary <PERMILLE>     Chance of a file being binary\n";
+}
+
+template <class T>
+auto parseNumber(std::string_view option, std::string_view value) -> T {
+  T result{};
+  auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+  if (ec != std::errc{} || ptr != value.data() + value.size()) {
+    std::cerr << "Error: Invalid value for " << option << " option: " << value << "\n";
+    std::exit(2);
+  }
+  return result;
+}
+
+auto parseArgs(std::span<char*> args) -> Options {
+  if (args.size() < 2) {
+    printHelp();
+    std::exit(2);
+  }
+
+  Options options;
+  options.OutDir = args[1];
+
+  // Overrides are applied after the profile, regardless of the order they are given in.
+  std::vector<std::pair<std::string_view, std::string_view>> overrides;
+
+  for (auto arg_it = args.begin() + 2; arg_it != args.end(); ++arg_it) {
+    const std::string_view arg = *arg_it;
+
+    if (arg == "--help" || arg == "-h") {
+      printHelp();
+      std::exit(2);
+    }
+
+    if (++arg_it == args.end()) {
+      std::cerr << "Error: Missing value for " << arg << " option.\n";
+      std::exit(2);
+    }
+    const std::string_view value = *arg_it;
+
+    if (arg == "--profile") {
+      const auto* profile = std::ranges::find(kProfiles, value, &Profile::Name);
+      if (profile == kProfiles.end()) {
+        std::cerr << "Error: Unknown profile '" << value << "'.\n";
+        std::exit(2);
+      }
+      options.TreeProfile = *profile;
+    } else if (arg == "--seed") {
+      options.Seed = parseNumber<std::uint64_t>(arg, value);
+    } else if (arg == "--needle") {
+      if (value.empty()) {
+        std::cerr << "Error: The needle must not be empty.\n";
+        std::exit(2);
+      }
+      options.Needle = value;
+    } else {
+      overrides.emplace_back(arg, value);
+    }
+  }
+
+  Profile& profile = options.TreeProfile;
+  for (const auto& [arg, value] : overrides) {
+    if (arg == "--depth") {
+      profile.Depth = parseNumber<std::uint32_t>(arg, value);
+    } else if (arg == "--fanout") {
+      profile.Fanout = parseNumber<std::uint32_t>(arg, value);
+    } else if (arg == "--files-per-dir") {
+      profile.FilesPerDir = parseNumber<std::uint32_t>(arg, value);
+    } else if (arg == "--min-size") {
+      profile.MinSize = parseNumber<std::uint64_t>(arg, value);
+    } else if (arg == "--max-size") {
+      profile.MaxSize = parseNumber<std::uint64_t>(arg, value);
+    } else if (arg == "--size-tail") {
+      profile.SizeTailPerMille = parseNumber<std::uint32_t>(arg, value);
+    } else if (arg == "--match") {
+      profile.MatchPerMille = parseNumber<std::uint32_t>(arg, value);
+    } else if (arg == "--binary") {
+      profile.BinaryPerMille = parseNumber<std::uint32_t>(arg, value);
+    } else {
+      std::cerr << "Error: Unknown option '" << arg << "'. Use --help for usage information.\n";
+      std::exit(2);
+    }
+  }
+
+  if (profile.MinSize == 0 || profile.MinSize > profile.MaxSize) {
+    std::cerr << "Error: --min-size must be positive and no larger than --max-size.\n";
+    std::exit(2);
+  }
+
+  return options;
+}
+
+auto Main(std::span<char*> args) -> int {
+  const Options options = parseArgs(args);
+  Generator{options}.Run();
+  return 0;
+}
+
+}  // namespace
+
+}  // namespace rbs::gencorpus
+
+auto main(int argc, char* argv[]) noexcept -> int {
+  try {
+    return rbs::gencorpus::Main(std::span<char*>{argv, static_cast<std::size_t>(argc)});
+  } catch (const std::exception& ex) {
+    std::cerr << std::format("An unhandled error has occurred: {}\n", ex.what());
+  } catch (...) {
+    std::cerr << "An unknown error has occurred.\n";
+  }
+  return 1;
+}